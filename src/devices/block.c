@@ -3,7 +3,15 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Buckets in a latency histogram.  Bucket 0 counts times under
+   2 us, bucket I > 0 times from 2**I up to 2**(I + 1) us, except
+   that the last one has no upper bound. */
+#define HIST_BUCKETS 22
 
 /* A block device. */
 struct block
@@ -16,11 +24,85 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    char channel[16];                   /* Hardware channel, shared with
+                                           the devices that must wait
+                                           for this one, or "". */
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* I/O scheduling.  Protected by disabling interrupts. */
+    const struct block_scheduler *sched; /* Null to pass requests
+                                            straight to the driver. */
+    struct list queue;                  /* Requests not yet dispatched. */
+    struct list read_fifo;              /* Queued reads, oldest first. */
+    struct list write_fifo;             /* Queued writes, oldest first. */
+    int writes_starved;                 /* Reads dispatched while writes
+                                           were waiting. */
+    int in_flight;                      /* Requests given to the driver. */
+    block_sector_t head;                /* Sector after the last one
+                                           dispatched. */
+
+    unsigned long long dispatch_cnt;    /* Requests given to the driver. */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+    unsigned long long seek_cnt;        /* Sum of the distances between
+                                           dispatched requests. */
+
+    /* Commands given to the driver.  Commands through the I/O
+       scheduler are timed from submission to dispatch (queue
+       time) and from dispatch to completion (service time). */
+    unsigned long long seq_cnt;         /* Commands starting at HEAD. */
+    unsigned long long random_cnt;      /* Other commands. */
+    unsigned long long queue_hist[HIST_BUCKETS];
+    unsigned long long service_hist[HIST_BUCKETS];
   };
 
+/* An entry in the I/O trace: one call of the block layer's
+   interface. */
+struct trace_entry
+  {
+    int64_t time;                       /* Microseconds since boot. */
+    struct block *block;                /* Device. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    bool is_write;                      /* Write? */
+    tid_t tid;                          /* Issuing thread. */
+    char thread_name[16];               /* Its name. */
+  };
+
+/* Number of calls kept in the trace.  Older ones are
+   overwritten. */
+#define TRACE_SIZE 256
+
+/* The trace, recorded and printed by block_print_stats() only if
+   enabled by block_enable_trace().  Protected by disabling
+   interrupts. */
+static bool trace_enabled;
+static struct trace_entry trace[TRACE_SIZE];
+static unsigned long long trace_cnt;    /* Calls recorded so far. */
+
+/* An I/O scheduler decides in which order a block device's
+   queued requests are handed to its driver. */
+struct block_scheduler
+  {
+    const char *name;
+    void (*add) (struct block *, struct block_request *);
+    struct block_request *(*next) (struct block *);
+  };
+
+/* Most requests a scheduled device's driver holds at once.
+   Keeping this low leaves the choice to the scheduler. */
+#define MAX_IN_FLIGHT 1
+
+/* Largest request, in sectors, that merging may build. */
+#define MAX_MERGE 256
+
+static const struct block_scheduler noop_scheduler;
+static const struct block_scheduler deadline_scheduler;
+
+/* Scheduler given to newly registered devices. */
+static const struct block_scheduler *default_scheduler = &deadline_scheduler;
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -28,6 +110,14 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, block_sector_t, void *buffer,
+                      block_sector_t cnt, bool is_write);
+static void submit_request (struct block *, struct block_request *);
+static void record_trace (struct block *, block_sector_t, block_sector_t cnt,
+                          bool is_write);
+static void print_hist (struct block *, const char *kind,
+                        const unsigned long long hist[HIST_BUCKETS]);
+static void print_trace (void);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -121,7 +211,8 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
+  record_trace (block, sector, 1, false);
+  transfer (block, sector, buffer, 1, false);
   block->read_cnt++;
 }
 
@@ -135,10 +226,531 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
+  record_trace (block, sector, 1, true);
+  transfer (block, sector, (void *) buffer, 1, true);
   block->write_cnt++;
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%"PRDSNu", "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
+/* Has BLOCK's driver read CNT sectors starting at SECTOR into
+   BUFFER, with as few calls as the driver allows. */
+static void
+read_sectors (struct block *block, block_sector_t sector,
+              void *buffer, block_sector_t cnt)
+{
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, buffer, cnt);
+  else
+    {
+      uint8_t *p = buffer;
+      block_sector_t i;
+
+      for (i = 0; i < cnt; i++)
+        block->ops->read (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Has BLOCK's driver write CNT sectors starting at SECTOR from
+   BUFFER, with as few calls as the driver allows. */
+static void
+write_sectors (struct block *block, block_sector_t sector,
+               const void *buffer, block_sector_t cnt)
+{
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, buffer, cnt);
+  else
+    {
+      const uint8_t *p = buffer;
+      block_sector_t i;
+
+      for (i = 0; i < cnt; i++)
+        block->ops->write (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Adds US microseconds to latency histogram HIST. */
+static void
+hist_add (unsigned long long hist[HIST_BUCKETS], int64_t us)
+{
+  int bucket = 0;
+
+  while (us > 1 && bucket < HIST_BUCKETS - 1)
+    {
+      us >>= 1;
+      bucket++;
+    }
+  hist[bucket]++;
+}
+
+/* Accounts for BLOCK's driver starting a command for CNT
+   sectors starting at SECTOR. */
+static void
+start_command (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  if (sector == block->head)
+    block->seq_cnt++;
+  else
+    block->random_cnt++;
+  block->seek_cnt += (sector > block->head
+                      ? sector - block->head
+                      : block->head - sector);
+  block->head = sector + cnt;
+  block->dispatch_cnt++;
+}
+
+/* Has BLOCK's driver, which has no request queue, transfer CNT
+   sectors starting at SECTOR between the device and BUFFER. */
+static void
+transfer_now (struct block *block, block_sector_t sector, void *buffer,
+              block_sector_t cnt, bool is_write)
+{
+  enum intr_level old_level;
+  int64_t start = timer_usecs ();
+
+  if (is_write)
+    write_sectors (block, sector, buffer, cnt);
+  else
+    read_sectors (block, sector, buffer, cnt);
+
+  old_level = intr_disable ();
+  start_command (block, sector, cnt);
+  hist_add (block->service_hist, timer_usecs () - start);
+  intr_set_level (old_level);
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER and waits for completion.  Goes through BLOCK's request
+   queue, if it has one, so that the I/O scheduler sees
+   synchronous requests too. */
+static void
+transfer (struct block *block, block_sector_t sector, void *buffer,
+          block_sector_t cnt, bool is_write)
+{
+  if (block->ops->submit != NULL)
+    {
+      struct block_request req;
+
+      block_request_init (&req, sector, buffer, cnt, is_write, NULL, NULL);
+      submit_request (block, &req);
+      block_wait (&req);
+    }
+  else
+    transfer_now (block, sector, buffer, cnt, is_write);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses as few device commands as the driver allows.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer, block_sector_t cnt)
+{
+  check_sectors (block, sector, cnt);
+  record_trace (block, sector, cnt, false);
+  transfer (block, sector, buffer, cnt, false);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer, block_sector_t cnt)
+{
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  record_trace (block, sector, cnt, true);
+  transfer (block, sector, (void *) buffer, cnt, true);
+  block->write_cnt += cnt;
+}
+
+/* Initializes REQ to transfer CNT sectors starting at SECTOR
+   between a block device and BUFFER, writing to the device if
+   IS_WRITE is true.  DONE, if non-null, will be called with REQ
+   when the transfer completes; REQ's AUX member is set to AUX
+   for its use.  Otherwise, wait for completion with
+   block_wait(). */
+void
+block_request_init (struct block_request *req, block_sector_t sector,
+                    void *buffer, block_sector_t cnt, bool is_write,
+                    void (*done) (struct block_request *), void *aux)
+{
+  req->sector = sector;
+  req->cnt = cnt;
+  req->buffer = buffer;
+  req->is_write = is_write;
+  req->done = done;
+  req->aux = aux;
+  sema_init (&req->sema, 0);
+  req->block = NULL;
+  req->total_cnt = cnt;
+  list_init (&req->merged);
+  req->driver = NULL;
+}
+
+/* Submits REQ to BLOCK.  With a driver that queues requests,
+   returns at once and REQ completes later; otherwise, REQ has
+   completed by the time this returns.  REQ must stay allocated
+   until it completes.  Must not be called from an interrupt
+   handler. */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+  check_sectors (block, req->sector, req->cnt);
+
+  /* A request that already has a device is being passed on by a
+     driver, e.g. from a partition to its disk, and has been
+     traced already. */
+  if (req->block == NULL)
+    record_trace (block, req->sector, req->cnt, req->is_write);
+
+  if (req->is_write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += req->cnt;
+    }
+  else
+    block->read_cnt += req->cnt;
+  submit_request (block, req);
+}
+
+/* Waits for REQ, which must not have a completion function, to
+   complete. */
+void
+block_wait (struct block_request *req)
+{
+  ASSERT (req->done == NULL);
+  sema_down (&req->sema);
+}
+
+/* Tries to append REQ to a queued request of BLOCK that ends
+   right where REQ begins, so that one command does both.
+   Returns true if successful. */
+static bool
+merge_request (struct block *block, struct block_request *req)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->is_write == req->is_write
+          && r->sector + r->total_cnt == req->sector
+          && r->total_cnt + req->cnt <= MAX_MERGE)
+        {
+          list_push_back (&r->merged, &req->elem);
+          r->total_cnt += req->cnt;
+          block->merge_cnt++;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Hands BLOCK's driver requests chosen by BLOCK's scheduler until
+   it holds MAX_IN_FLIGHT of them. */
+static void
+dispatch (struct block *block)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (block->in_flight < MAX_IN_FLIGHT)
+    {
+      struct block_request *req = block->sched->next (block);
+      int64_t now;
+
+      if (req == NULL)
+        break;
+
+      start_command (block, req->sector, req->total_cnt);
+      now = timer_usecs ();
+      hist_add (block->queue_hist, now - req->stamp);
+      req->stamp = now;
+      block->in_flight++;
+      block->ops->submit (block->aux, req);
+    }
+}
+
+/* Submits REQ to BLOCK without checking it or counting it in
+   BLOCK's statistics. */
+static void
+submit_request (struct block *block, struct block_request *req)
+{
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  req->block = block;
+  req->total_cnt = req->cnt;
+  list_init (&req->merged);
+  req->stamp = timer_usecs ();
+
+  if (block->ops->submit == NULL)
+    {
+      transfer_now (block, req->sector, req->buffer, req->cnt, req->is_write);
+      block_request_done (req);
+    }
+  else if (block->sched == NULL)
+    block->ops->submit (block->aux, req);
+  else
+    {
+      old_level = intr_disable ();
+      if (!merge_request (block, req))
+        block->sched->add (block, req);
+      dispatch (block);
+      intr_set_level (old_level);
+    }
+}
+
+/* Signals the completion of REQ to its submitter. */
+static void
+finish_request (struct block_request *req)
+{
+  if (req->done != NULL)
+    req->done (req);
+  else
+    sema_up (&req->sema);
+}
+
+/* Called by a driver, possibly from an interrupt handler, when
+   REQ, including any requests merged into it, has completed. */
+void
+block_request_done (struct block_request *req)
+{
+  struct block *block = req->block;
+  enum intr_level old_level = intr_disable ();
+
+  /* Keep the device busy before running completion functions. */
+  if (block != NULL && block->sched != NULL && block->ops->submit != NULL)
+    {
+      hist_add (block->service_hist, timer_usecs () - req->stamp);
+      block->in_flight--;
+      dispatch (block);
+    }
+
+  while (!list_empty (&req->merged))
+    finish_request (list_entry (list_pop_front (&req->merged),
+                                struct block_request, elem));
+  finish_request (req);
+  intr_set_level (old_level);
+}
+
+/* Returns the buffer for sector I of REQ, counting the sectors
+   of the requests merged into REQ. */
+void *
+block_request_buffer (struct block_request *req, block_sector_t i)
+{
+  struct list_elem *e;
+
+  ASSERT (i < req->total_cnt);
+  if (i < req->cnt)
+    return (uint8_t *) req->buffer + i * BLOCK_SECTOR_SIZE;
+  i -= req->cnt;
+  for (e = list_begin (&req->merged); ; e = list_next (e))
+    {
+      struct block_request *m = list_entry (e, struct block_request, elem);
+      ASSERT (e != list_end (&req->merged));
+      if (i < m->cnt)
+        return (uint8_t *) m->buffer + i * BLOCK_SECTOR_SIZE;
+      i -= m->cnt;
+    }
+}
+
+/* I/O schedulers. */
+
+/* "noop": dispatches requests in arrival order. */
+
+static void
+noop_add (struct block *block, struct block_request *req)
+{
+  list_push_back (&block->queue, &req->elem);
+}
+
+static struct block_request *
+noop_next (struct block *block)
+{
+  if (list_empty (&block->queue))
+    return NULL;
+  return list_entry (list_pop_front (&block->queue),
+                     struct block_request, elem);
+}
+
+static const struct block_scheduler noop_scheduler =
+  {
+    "noop",
+    noop_add,
+    noop_next
+  };
+
+/* "deadline": sweeps the disk in one direction (C-SCAN), serving
+   reads before writes.  Writes are passed over at most
+   WRITES_STARVED times in a row, and a request whose deadline
+   has passed is served first. */
+
+/* Ticks a read or write may wait before it is served out of
+   order. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
+
+/* Times reads may be preferred while writes are waiting. */
+#define WRITES_STARVED 2
+
+/* Orders requests by sector. */
+static bool
+sector_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+static void
+deadline_add (struct block *block, struct block_request *req)
+{
+  req->deadline = timer_ticks () + (req->is_write ? WRITE_EXPIRE : READ_EXPIRE);
+  list_insert_ordered (&block->queue, &req->elem, sector_less, NULL);
+  list_push_back (req->is_write ? &block->write_fifo : &block->read_fifo,
+                  &req->fifo_elem);
+}
+
+static struct block_request *
+deadline_next (struct block *block)
+{
+  bool have_reads = !list_empty (&block->read_fifo);
+  bool have_writes = !list_empty (&block->write_fifo);
+  struct block_request *req, *first = NULL;
+  struct list *fifo;
+  struct list_elem *e;
+  bool is_write;
+
+  if (!have_reads && !have_writes)
+    return NULL;
+
+  /* Pick a direction. */
+  if (have_reads && (!have_writes || block->writes_starved < WRITES_STARVED))
+    {
+      is_write = false;
+      if (have_writes)
+        block->writes_starved++;
+    }
+  else
+    {
+      is_write = true;
+      block->writes_starved = 0;
+    }
+  fifo = is_write ? &block->write_fifo : &block->read_fifo;
+
+  /* Serve the oldest request if it expired, else the next one
+     at or after the head, wrapping around to the lowest. */
+  req = list_entry (list_front (fifo), struct block_request, fifo_elem);
+  if (timer_ticks () < req->deadline)
+    {
+      req = NULL;
+      for (e = list_begin (&block->queue); e != list_end (&block->queue);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          if (r->is_write != is_write)
+            continue;
+          if (first == NULL)
+            first = r;
+          if (r->sector >= block->head)
+            {
+              req = r;
+              break;
+            }
+        }
+      if (req == NULL)
+        req = first;
+    }
+
+  list_remove (&req->elem);
+  list_remove (&req->fifo_elem);
+  return req;
+}
+
+static const struct block_scheduler deadline_scheduler =
+  {
+    "deadline",
+    deadline_add,
+    deadline_next
+  };
+
+/* Returns the scheduler named NAME, or a null pointer for "none".
+   Sets *FOUND to whether NAME is known. */
+static const struct block_scheduler *
+find_scheduler (const char *name, bool *found)
+{
+  static const struct block_scheduler *schedulers[] =
+    {
+      &noop_scheduler,
+      &deadline_scheduler,
+    };
+  size_t i;
+
+  *found = true;
+  if (!strcmp (name, "none"))
+    return NULL;
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (!strcmp (name, schedulers[i]->name))
+      return schedulers[i];
+  *found = false;
+  return NULL;
+}
+
+/* Makes BLOCK use the I/O scheduler named NAME: "deadline",
+   "noop", or "none" to pass requests straight to the driver.
+   BLOCK must be idle.  Returns false if there is no such
+   scheduler. */
+bool
+block_set_scheduler (struct block *block, const char *name)
+{
+  bool found;
+  const struct block_scheduler *sched = find_scheduler (name, &found);
+
+  if (!found)
+    return false;
+  ASSERT (list_empty (&block->queue));
+  ASSERT (block->in_flight == 0);
+  block->sched = sched;
+  return true;
+}
+
+/* Makes block devices registered from now on use the I/O
+   scheduler named NAME.  Returns false if there is no such
+   scheduler. */
+bool
+block_set_default_scheduler (const char *name)
+{
+  bool found;
+  const struct block_scheduler *sched = find_scheduler (name, &found);
+
+  if (found)
+    default_scheduler = sched;
+  return found;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -160,10 +772,38 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Records that BLOCK's requests go through the hardware channel
+   named CHANNEL, e.g. "ide0".  Devices on the same channel wait
+   for each other; devices on different channels work in
+   parallel. */
+void
+block_set_channel (struct block *block, const char *channel)
+{
+  strlcpy (block->channel, channel != NULL ? channel : "",
+           sizeof block->channel);
+}
+
+/* Returns the name of BLOCK's hardware channel, or "" if it is
+   unknown. */
+const char *
+block_channel (struct block *block)
+{
+  return block->channel;
+}
+
+/* Returns true if A and B are known to share a hardware
+   channel. */
+bool
+block_same_channel (struct block *a, struct block *b)
+{
+  return a->channel[0] != '\0' && !strcmp (a->channel, b->channel);
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,6 +816,99 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  /* Requests are scheduled on the disks underneath the role
+     devices. */
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->dispatch_cnt == 0)
+        continue;
+      printf ("%s (%s): %s scheduler, %llu requests, %llu merged, "
+              "%llu sectors average seek\n",
+              block->name,
+              block->channel[0] != '\0' ? block->channel : "no channel",
+              block->ops->submit != NULL && block->sched != NULL
+              ? block->sched->name : "no",
+              block->dispatch_cnt, block->merge_cnt,
+              block->seek_cnt / block->dispatch_cnt);
+      printf ("%s: %llu sequential, %llu random commands\n",
+              block->name, block->seq_cnt, block->random_cnt);
+      print_hist (block, "queue", block->queue_hist);
+      print_hist (block, "service", block->service_hist);
+    }
+
+  if (trace_enabled)
+    print_trace ();
+}
+
+/* Has block_print_stats() print the last TRACE_SIZE calls of
+   block_read(), block_write() and the like, for finding out
+   which code issues which I/O. */
+void
+block_enable_trace (void)
+{
+  trace_enabled = true;
+}
+
+/* Records a call for CNT sectors starting at SECTOR on BLOCK in
+   the trace, if it is enabled. */
+static void
+record_trace (struct block *block, block_sector_t sector,
+              block_sector_t cnt, bool is_write)
+{
+  struct thread *t = thread_current ();
+  struct trace_entry *te;
+  enum intr_level old_level;
+
+  if (!trace_enabled)
+    return;
+
+  old_level = intr_disable ();
+  te = &trace[trace_cnt++ % TRACE_SIZE];
+  te->time = timer_usecs ();
+  te->block = block;
+  te->sector = sector;
+  te->cnt = cnt;
+  te->is_write = is_write;
+  te->tid = t->tid;
+  strlcpy (te->thread_name, t->name, sizeof te->thread_name);
+  intr_set_level (old_level);
+}
+
+/* Prints the non-empty buckets of BLOCK's latency histogram
+   HIST, which is for the given KIND of time. */
+static void
+print_hist (struct block *block, const char *kind,
+            const unsigned long long hist[HIST_BUCKETS])
+{
+  int i;
+
+  printf ("%s: %s time:", block->name, kind);
+  for (i = 0; i < HIST_BUCKETS; i++)
+    if (hist[i] > 0)
+      printf (" %lld+us %llu", i > 0 ? 1LL << i : 0LL, hist[i]);
+  printf ("\n");
+}
+
+/* Prints the trace, oldest call first. */
+static void
+print_trace (void)
+{
+  unsigned long long i;
+  unsigned long long first = (trace_cnt > TRACE_SIZE
+                              ? trace_cnt - TRACE_SIZE : 0);
+
+  printf ("I/O trace, last %llu of %llu calls:\n",
+          trace_cnt - first, trace_cnt);
+  for (i = first; i < trace_cnt; i++)
+    {
+      const struct trace_entry *te = &trace[i % TRACE_SIZE];
+      printf ("%10"PRId64" us %s %c %"PRDSNu"+%"PRDSNu" by %s (tid %d)\n",
+              te->time, te->block->name, te->is_write ? 'W' : 'R',
+              te->sector, te->cnt, te->thread_name, te->tid);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -198,8 +931,23 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
+  block->channel[0] = '\0';
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->sched = default_scheduler;
+  list_init (&block->queue);
+  list_init (&block->read_fifo);
+  list_init (&block->write_fifo);
+  block->writes_starved = 0;
+  block->in_flight = 0;
+  block->head = 0;
+  block->dispatch_cnt = 0;
+  block->merge_cnt = 0;
+  block->seek_cnt = 0;
+  block->seq_cnt = 0;
+  block->random_cnt = 0;
+  memset (block->queue_hist, 0, sizeof block->queue_hist);
+  memset (block->service_hist, 0, sizeof block->service_hist);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
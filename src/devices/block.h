@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +55,63 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, void *,
+                          block_sector_t cnt);
+void block_write_multiple (struct block *, block_sector_t, const void *,
+                           block_sector_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Topology. */
+void block_set_channel (struct block *, const char *channel);
+const char *block_channel (struct block *);
+bool block_same_channel (struct block *, struct block *);
+
+/* Asynchronous requests. */
+
+/* A request to transfer CNT sectors starting at SECTOR between a
+   block device and BUFFER.  Once submitted, the request belongs
+   to the block layer and its driver until it completes. */
+struct block_request
+  {
+    struct list_elem elem;      /* Element in a driver's queue. */
+    block_sector_t sector;      /* First sector. */
+    block_sector_t cnt;         /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool is_write;              /* Write to the device? */
+
+    /* Called on completion, possibly from an interrupt handler,
+       so it must not sleep.  If null, SEMA is up'd instead. */
+    void (*done) (struct block_request *);
+    void *aux;                  /* For use by DONE. */
+    struct semaphore sema;      /* Up'd on completion if DONE is null. */
+
+    /* Owned by the block layer and its I/O scheduler. */
+    struct block *block;        /* Device that schedules the request. */
+    block_sector_t total_cnt;   /* CNT plus the sectors of MERGED. */
+    struct list merged;         /* Requests for the sectors right after
+                                   this one, done by the same command. */
+    struct list_elem fifo_elem; /* Element in a scheduler FIFO. */
+    int64_t deadline;           /* Tick by which it should be started. */
+    int64_t stamp;              /* Time submitted, then time started,
+                                   in microseconds. */
+
+    void *driver;               /* Owned by the driver. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t sector,
+                         void *buffer, block_sector_t cnt, bool is_write,
+                         void (*done) (struct block_request *), void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
+/* I/O schedulers. */
+bool block_set_scheduler (struct block *, const char *name);
+bool block_set_default_scheduler (const char *name);
+
 /* Statistics. */
 void block_print_stats (void);
+void block_enable_trace (void);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,10 +119,25 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors at once.  If
+       null, the block layer calls read or write once per
+       sector. */
+    void (*read_multiple) (void *aux, block_sector_t, void *buffer,
+                           block_sector_t cnt);
+    void (*write_multiple) (void *aux, block_sector_t, const void *buffer,
+                            block_sector_t cnt);
+
+    /* Optional.  Queues REQ and returns at once; the driver calls
+       block_request_done() when REQ completes.  If null, the
+       block layer performs REQ synchronously on submission. */
+    void (*submit) (void *aux, struct block_request *req);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_request_done (struct block_request *);
+void *block_request_buffer (struct block_request *, block_sector_t);
 
 #endif /* devices/block.h */
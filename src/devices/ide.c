@@ -9,9 +9,13 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If the
+   controller is a PCI bus master IDE controller, such as the
+   PIIX emulated by QEMU and Bochs, data is moved by DMA;
+   otherwise, or if a buffer is unsuitable for DMA, by PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +34,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start/stop transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Transfer failed (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt (write 1 to clear). */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +68,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors one command can transfer.  A sector count of 0
+   in the Sector Count register means 256. */
+#define MAX_NSECT 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +85,27 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple_cnt;           /* Sectors per interrupt in READ/WRITE
+                                   MULTIPLE, or 1 if not supported. */
+    bool dma;                   /* Use bus master DMA? */
   };
 
+/* Physical Region Descriptor, one entry of the table that tells
+   a bus master which memory to transfer.  A region may not cross
+   a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Byte count, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Number of PRD entries per channel.  Merged requests bring one
+   region per buffer; commands that need more use PIO. */
+#define PRD_CNT 64
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -67,11 +114,22 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, 0 if none. */
+    struct prd *prdt;           /* PRD table. */
+
+    /* Request queue, shared by both devices.  Protected by
+       disabling interrupts. */
+    struct list queue;          /* Queued block_requests. */
+    struct block_request *active; /* Request being served, or null. */
+    block_sector_t done_cnt;    /* Sectors of ACTIVE already done. */
+    int nsect;                  /* Sectors in the current command. */
+    int left;                   /* Sectors of it still to move. */
+    bool use_dma;               /* Is the current command DMA? */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -79,19 +137,34 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* PRD tables for the channels.  Aligned so that no table crosses
+   a 64 kB boundary. */
+static struct prd prdts[CHANNEL_CNT][PRD_CNT]
+  __attribute__ ((aligned (sizeof (struct prd) * PRD_CNT)));
+
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, const uint16_t *id);
+static void select_sector (struct ata_disk *, block_sector_t, int cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
+static void start_next (struct channel *);
+static void start_command (struct channel *);
+static void transfer_block (struct channel *);
+static void service_request (struct channel *);
+static bool setup_dma (struct channel *);
+static void finish_dma (struct channel *);
+
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool poll_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,6 +174,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +197,12 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      list_init (&c->queue);
+      c->active = NULL;
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+      c->prdt = prdts[chan_no];
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +213,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple_cnt = 1;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +236,66 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Reads the 32-bit register at offset REG of the configuration
+   space of PCI function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG of the
+   configuration space of PCI function FUNC of device DEV on
+   bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for a bus master IDE controller whose
+   channels are at the legacy ports we drive, enables bus
+   mastering on it and returns its bus master base port.
+   Returns 0 if there is none. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t id = pci_read_config (dev, func, 0x00);
+        uint32_t class = pci_read_config (dev, func, 0x08) >> 8;
+        uint32_t bar4, command;
+
+        if ((id & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 01h (mass storage), subclass 01h (IDE), bus
+           master capable, both channels in compatibility mode. */
+        if ((class >> 8) != 0x0101 || (class & 0x80) == 0
+            || (class & 0x05) != 0)
+          continue;
+
+        bar4 = pci_read_config (dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering. */
+        command = pci_read_config (dev, func, 0x04);
+        pci_write_config (dev, func, 0x04, command | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -287,7 +426,8 @@ identify_ata_device (struct ata_disk *d)
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\", %s %s", model, serial,
+            c->name, d->dev_no == 0 ? "master" : "slave");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -303,12 +443,39 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  set_multiple_mode (d, (const uint16_t *) id);
+
+  /* Word 49 bit 8: DMA supported. */
+  d->dma = c->bm_base != 0 && (((const uint16_t *) id)[49] & 0x100) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_set_channel (block, c->name);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with the largest block
+   size that D's IDENTIFY DEVICE data ID allows.  Leaves D's
+   multiple_cnt at 1 if D doesn't support it. */
+static void
+set_multiple_mode (struct ata_disk *d, const uint16_t *id)
+{
+  struct channel *c = d->channel;
+  int max_cnt = id[47] & 0xff;
+
+  if (max_cnt <= 1)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max_cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple_cnt = max_cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,6 +504,56 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Queues REQ for disk D on D's channel and starts it if the
+   channel is idle.  The channel's interrupt handler carries the
+   request forward and then starts the next one, so requests of
+   both disks on a channel are served in order without a thread
+   waiting on each. */
+static void
+ide_submit (void *d_, struct block_request *req)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  enum intr_level old_level;
+
+  req->driver = d;
+  old_level = intr_disable ();
+  list_push_back (&c->queue, &req->elem);
+  start_next (c);
+  intr_set_level (old_level);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, void *buffer,
+                   block_sector_t cnt)
+{
+  struct block_request req;
+
+  block_request_init (&req, sec_no, buffer, cnt, false, NULL, NULL);
+  ide_submit (d_, &req);
+  block_wait (&req);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving all of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, const void *buffer,
+                    block_sector_t cnt)
+{
+  struct block_request req;
+
+  block_request_init (&req, sec_no, (void *) buffer, cnt, true, NULL, NULL);
+  ide_submit (d_, &req);
+  block_wait (&req);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
@@ -344,16 +561,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multiple (d_, sec_no, buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +572,142 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  ide_write_multiple (d_, sec_no, buffer, 1);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_submit
   };
-
+
+/* Request processing.  Everything here runs with interrupts
+   off, either in ide_submit() or in the interrupt handler, so it
+   busy-waits instead of sleeping. */
+
+/* Makes the first request in channel C's queue active and starts
+   it, unless a request is active already or the queue is
+   empty. */
+static void
+start_next (struct channel *c)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->active != NULL || list_empty (&c->queue))
+    return;
+  c->active = list_entry (list_pop_front (&c->queue),
+                          struct block_request, elem);
+  c->done_cnt = 0;
+  start_command (c);
+}
+
+/* Issues the command for the next run of at most MAX_NSECT
+   sectors of channel C's active request. */
+static void
+start_command (struct channel *c)
+{
+  struct block_request *req = c->active;
+  struct ata_disk *d = req->driver;
+  block_sector_t left = req->total_cnt - c->done_cnt;
+  uint8_t command;
+
+  c->nsect = left < MAX_NSECT ? left : MAX_NSECT;
+  c->left = c->nsect;
+  c->use_dma = setup_dma (c);
+
+  select_sector (d, req->sector + c->done_cnt, c->nsect);
+  if (c->use_dma)
+    command = req->is_write ? CMD_WRITE_DMA : CMD_READ_DMA;
+  else if (req->is_write)
+    command = (d->multiple_cnt > 1
+               ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+  else
+    command = (d->multiple_cnt > 1
+               ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+  c->expecting_interrupt = true;
+  outb (reg_command (c), command);
+
+  if (c->use_dma)
+    outb (reg_bm_command (c), inb (reg_bm_command (c)) | BM_CMD_START);
+  else if (req->is_write)
+    {
+      /* The disk asks for the first block without an
+         interrupt. */
+      transfer_block (c);
+    }
+}
+
+/* Moves the next DRQ block, that is, up to multiple_cnt sectors,
+   of channel C's active PIO command. */
+static void
+transfer_block (struct channel *c)
+{
+  struct block_request *req = c->active;
+  struct ata_disk *d = req->driver;
+  int blk = c->left < d->multiple_cnt ? c->left : d->multiple_cnt;
+
+  if (!poll_drq (d))
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           req->is_write ? "write" : "read",
+           req->sector + c->done_cnt + (c->nsect - c->left));
+  for (; blk > 0; blk--, c->left--)
+    {
+      void *buffer = block_request_buffer (req, c->done_cnt
+                                                + (c->nsect - c->left));
+      if (req->is_write)
+        output_sector (c, buffer);
+      else
+        input_sector (c, buffer);
+    }
+}
+
+/* Handles an interrupt for channel C's active request: moves
+   data or finishes DMA, then issues the next command of the
+   request, or completes it and starts the next request. */
+static void
+service_request (struct channel *c)
+{
+  struct block_request *req = c->active;
+
+  if (c->use_dma)
+    finish_dma (c);
+  else if (!req->is_write || c->left > 0)
+    {
+      /* A read block is ready, or the disk wants the next write
+         block. */
+      transfer_block (c);
+      if (c->left > 0 || req->is_write)
+        return;
+    }
+
+  c->done_cnt += c->nsect;
+  if (c->done_cnt < req->total_cnt)
+    {
+      start_command (c);
+      return;
+    }
+
+  c->active = NULL;
+  block_request_done (req);
+  start_next (c);
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, at most MAX_NSECT, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, int cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_NSECT);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_NSECT ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -402,7 +716,9 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt on C's completion_wait.  Only used while
+   probing; afterward all commands go through the request
+   queue. */
 static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
@@ -430,6 +746,84 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Prepares channel C's bus master for the current command of
+   C's active request.  Returns false, without doing anything, if
+   the disk can't do DMA or the request's buffers are not
+   suitable, in which case PIO must be used. */
+static bool
+setup_dma (struct channel *c)
+{
+  struct block_request *req = c->active;
+  struct ata_disk *d = req->driver;
+  int cnt = 0;
+  int i;
+
+  if (!d->dma)
+    return false;
+
+  /* Build the PRD table one sector at a time, extending the last
+     region while the buffers are physically contiguous and no
+     64 kB boundary is crossed.  The bus master needs even-aligned
+     buffers.  Kernel virtual memory maps physical memory
+     linearly. */
+  for (i = 0; i < c->nsect; i++)
+    {
+      void *buffer = block_request_buffer (req, c->done_cnt + i);
+      uintptr_t phys;
+      struct prd *last = cnt > 0 ? &c->prdt[cnt - 1] : NULL;
+
+      if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+        return false;
+      phys = vtop (buffer);
+      if (last != NULL && last->addr + last->size == phys
+          && (phys & 0xffff) != 0)
+        {
+          /* A region of exactly 64 kB wraps SIZE to 0, which is
+             how the bus master encodes it. */
+          last->size += BLOCK_SECTOR_SIZE;
+        }
+      else if ((phys & 0xffff) > 0x10000 - BLOCK_SECTOR_SIZE)
+        return false;
+      else if (cnt < PRD_CNT)
+        {
+          c->prdt[cnt].addr = phys;
+          c->prdt[cnt].size = BLOCK_SECTOR_SIZE;
+          c->prdt[cnt].flags = 0;
+          cnt++;
+        }
+      else
+        return false;
+    }
+
+  c->prdt[cnt - 1].flags = PRD_EOT;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), req->is_write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_IRQ);
+  return true;
+}
+
+/* Stops channel C's bus master after the completion interrupt of
+   a DMA command and checks for errors. */
+static void
+finish_dma (struct channel *c)
+{
+  struct block_request *req = c->active;
+  struct ata_disk *d = req->driver;
+  uint8_t bm_status, status;
+
+  outb (reg_bm_command (c), inb (reg_bm_command (c)) & ~BM_CMD_START);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_IRQ);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & BM_STA_ERR) != 0 || (status & (STA_ERR | STA_BSY)) != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           req->is_write ? "DMA write" : "DMA read",
+           req->sector + c->done_cnt);
+  c->left = 0;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -446,7 +840,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +873,25 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Busy-waits up to 1 second for disk D to clear BSY, and then
+   returns the status of the DRQ bit.  Unlike wait_while_busy(),
+   may be called with interrupts off. */
+static bool
+poll_drq (const struct ata_disk *d) 
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +902,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -514,7 +927,10 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            if (c->active != NULL)
+              service_request (c);              /* Carry the request on. */
+            else
+              sema_up (&c->completion_wait);    /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
@@ -0,0 +1,209 @@
+#include "devices/ramdisk.h"
+#include <ctype.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory, for measuring the file
+   system and VM code without the cost of emulated disk
+   hardware, and for scratch space.
+
+   Ramdisks are requested on the kernel command line and show up
+   as ram0, ram1, ... of type BLOCK_RAW, so they are only put to
+   use when named, e.g. "-filesys=ram0".  Their contents start
+   out zeroed and are lost at shutdown.  Memory comes from the
+   kernel pool one page at a time, when a page is first
+   written. */
+
+/* Maximum number of ramdisks. */
+#define RAMDISK_CNT 4
+
+/* Sectors per page of ramdisk memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A ramdisk. */
+struct ramdisk
+  {
+    char name[16];                      /* "ram0" etc. */
+    block_sector_t size;                /* Size in sectors. */
+    uint8_t **pages;                    /* Pages, null until written. */
+    size_t page_cnt;                    /* Number of elements in PAGES. */
+    struct lock alloc_lock;             /* Serializes page allocation. */
+  };
+
+static struct ramdisk ramdisks[RAMDISK_CNT];
+static int ramdisk_cnt;
+
+/* Busy time added to each command, in microseconds. */
+static int64_t latency;
+
+static struct block_operations ramdisk_operations;
+
+/* Requests a ramdisk of SIZE kB, or of SIZE MB if SIZE ends in
+   "M".  Returns false if SIZE is malformed or too many ramdisks
+   have been requested.  The ramdisk is created by
+   ramdisk_init(). */
+bool
+ramdisk_add (const char *size)
+{
+  struct ramdisk *rd;
+  unsigned long kb = 0;
+  const char *end;
+
+  if (size == NULL || ramdisk_cnt >= RAMDISK_CNT)
+    return false;
+  for (end = size; isdigit (*end) && kb < 1024 * 1024; end++)
+    kb = kb * 10 + (*end - '0');
+  if (*end == 'M' || *end == 'm')
+    {
+      kb *= 1024;
+      end++;
+    }
+  else if (*end == 'K' || *end == 'k')
+    end++;
+  if (end == size || *end != '\0' || kb == 0 || kb > 1024 * 1024)
+    return false;
+
+  rd = &ramdisks[ramdisk_cnt];
+  snprintf (rd->name, sizeof rd->name, "ram%d", ramdisk_cnt);
+  rd->size = kb * (1024 / BLOCK_SECTOR_SIZE);
+  ramdisk_cnt++;
+  return true;
+}
+
+/* Makes every ramdisk command take at least MICROSECONDS, to
+   simulate slower devices. */
+void
+ramdisk_set_latency (int64_t microseconds)
+{
+  latency = microseconds;
+}
+
+/* Registers the ramdisks requested with ramdisk_add(). */
+void
+ramdisk_init (void)
+{
+  int i;
+
+  for (i = 0; i < ramdisk_cnt; i++)
+    {
+      struct ramdisk *rd = &ramdisks[i];
+      char extra_info[64];
+      struct block *block;
+
+      rd->page_cnt = DIV_ROUND_UP (rd->size, SECTORS_PER_PAGE);
+      rd->pages = calloc (rd->page_cnt, sizeof *rd->pages);
+      if (rd->pages == NULL)
+        PANIC ("%s: out of memory", rd->name);
+      lock_init (&rd->alloc_lock);
+
+      snprintf (extra_info, sizeof extra_info, "%"PRId64" us latency",
+                latency);
+      block = block_register (rd->name, BLOCK_RAW, extra_info, rd->size,
+                              &ramdisk_operations, rd);
+      block_set_channel (block, rd->name);
+    }
+}
+
+/* Simulates the device latency of one command. */
+static void
+delay (void)
+{
+  if (latency <= 0)
+    return;
+  if (intr_get_level () == INTR_ON)
+    timer_usleep (latency);
+  else
+    timer_udelay (latency);
+}
+
+/* Returns the memory backing SECTOR in RD, or a null pointer if
+   it has never been written.  If ALLOCATE is true, allocates
+   zeroed memory for it instead of returning a null pointer. */
+static uint8_t *
+sector_data (struct ramdisk *rd, block_sector_t sector, bool allocate)
+{
+  uint8_t **page = &rd->pages[sector / SECTORS_PER_PAGE];
+
+  if (*page == NULL)
+    {
+      if (!allocate)
+        return NULL;
+      lock_acquire (&rd->alloc_lock);
+      if (*page == NULL)
+        {
+          *page = palloc_get_page (PAL_ZERO);
+          if (*page == NULL)
+            PANIC ("%s: out of memory", rd->name);
+        }
+      lock_release (&rd->alloc_lock);
+    }
+  return *page + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads CNT sectors starting at SEC_NO from ramdisk RD_ into
+   BUFFER. */
+static void
+ramdisk_read_multiple (void *rd_, block_sector_t sec_no, void *buffer,
+                       block_sector_t cnt)
+{
+  struct ramdisk *rd = rd_;
+  uint8_t *dst = buffer;
+  block_sector_t i;
+
+  for (i = 0; i < cnt; i++, dst += BLOCK_SECTOR_SIZE)
+    {
+      const uint8_t *src = sector_data (rd, sec_no + i, false);
+      if (src != NULL)
+        memcpy (dst, src, BLOCK_SECTOR_SIZE);
+      else
+        memset (dst, 0, BLOCK_SECTOR_SIZE);
+    }
+  delay ();
+}
+
+/* Writes CNT sectors starting at SEC_NO to ramdisk RD_ from
+   BUFFER. */
+static void
+ramdisk_write_multiple (void *rd_, block_sector_t sec_no,
+                        const void *buffer, block_sector_t cnt)
+{
+  struct ramdisk *rd = rd_;
+  const uint8_t *src = buffer;
+  block_sector_t i;
+
+  for (i = 0; i < cnt; i++, src += BLOCK_SECTOR_SIZE)
+    memcpy (sector_data (rd, sec_no + i, true), src, BLOCK_SECTOR_SIZE);
+  delay ();
+}
+
+/* Reads sector SEC_NO from ramdisk RD_ into BUFFER. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  ramdisk_read_multiple (rd_, sec_no, buffer, 1);
+}
+
+/* Writes sector SEC_NO to ramdisk RD_ from BUFFER. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  ramdisk_write_multiple (rd_, sec_no, buffer, 1);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL
+  };
@@ -0,0 +1,11 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool ramdisk_add (const char *size);
+void ramdisk_set_latency (int64_t microseconds);
+void ramdisk_init (void);
+
+#endif /* devices/ramdisk.h */
@@ -89,6 +89,29 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of microseconds since the OS booted.
+   Interpolates between timer ticks by reading the PIT, so it is
+   much finer grained than timer_ticks(). */
+int64_t
+timer_usecs (void)
+{
+  /* PIT cycles per timer tick, as set up by timer_init(). */
+  const int64_t period = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
+  static int64_t last;
+  enum intr_level old_level = intr_disable ();
+  int64_t cycles = period - pit_read_counter (0);
+  int64_t us = ticks * (1000 * 1000 / TIMER_FREQ)
+               + cycles * 1000 * 1000 / PIT_HZ;
+
+  /* The counter may have restarted before its interrupt was
+     handled.  Never go backward. */
+  if (us < last)
+    us = last;
+  last = us;
+  intr_set_level (old_level);
+  return us;
+}
+
 /* Static function that compares the sleeping time of two threads. */
 static bool
 compare_sleeping_ticks(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
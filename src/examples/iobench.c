@@ -0,0 +1,122 @@
+/* iobench.c
+
+   Runs swap traffic and file system traffic at the same time,
+   to compare a swap device on the file system disk's IDE
+   channel with one on the other channel.
+
+   "iobench" starts "iobench swap", which repeatedly dirties an
+   array too large for physical memory, and meanwhile writes a
+   file and reads it back.  Run it once with the swap disk on the
+   same channel as the file system disk and once on the other
+   channel, e.g. with "-swap=hdb" and "-swap=hdc" on the kernel
+   command line, and compare the "Timer:" ticks and the block
+   device statistics printed at shutdown. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of the array that is swapped.  Should be larger than
+   the physical memory given to Pintos. */
+#define SWAP_SIZE (6 * 1024 * 1024)
+
+/* Number of passes over the array. */
+#define SWAP_PASSES 4
+
+/* Size of the file written and read back, and of each
+   transfer. */
+#define FILE_SIZE (1024 * 1024)
+#define CHUNK_SIZE 4096
+
+/* Number of times the file is written and read back. */
+#define FILE_PASSES 4
+
+static char swap_data[SWAP_SIZE];
+static char buf[CHUNK_SIZE];
+
+/* Dirties every page of swap_data SWAP_PASSES times. */
+static int
+run_swap (void)
+{
+  int pass;
+  size_t i;
+
+  for (pass = 0; pass < SWAP_PASSES; pass++)
+    for (i = 0; i < SWAP_SIZE; i += 4096)
+      swap_data[i] = pass;
+  for (i = 0; i < SWAP_SIZE; i += 4096)
+    if (swap_data[i] != SWAP_PASSES - 1)
+      {
+        printf ("iobench: swap data corrupted at offset %zu\n", i);
+        return EXIT_FAILURE;
+      }
+  return EXIT_SUCCESS;
+}
+
+/* Writes and reads back a FILE_SIZE byte file FILE_PASSES
+   times. */
+static int
+run_file (void)
+{
+  int pass;
+
+  if (!create ("iobench.dat", 0))
+    {
+      printf ("iobench: create failed\n");
+      return EXIT_FAILURE;
+    }
+  for (pass = 0; pass < FILE_PASSES; pass++)
+    {
+      int fd = open ("iobench.dat");
+      int ofs;
+
+      if (fd < 0)
+        {
+          printf ("iobench: open failed\n");
+          return EXIT_FAILURE;
+        }
+      memset (buf, pass, sizeof buf);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+        if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+          {
+            printf ("iobench: write failed\n");
+            return EXIT_FAILURE;
+          }
+      fsync (fd);
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+        if (read (fd, buf, CHUNK_SIZE) != CHUNK_SIZE
+            || buf[0] != pass || buf[CHUNK_SIZE - 1] != pass)
+          {
+            printf ("iobench: read back failed\n");
+            return EXIT_FAILURE;
+          }
+      close (fd);
+    }
+  remove ("iobench.dat");
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t child;
+  int file_status, swap_status;
+
+  if (argc == 2 && !strcmp (argv[1], "swap"))
+    return run_swap ();
+
+  child = exec ("iobench swap");
+  if (child == PID_ERROR)
+    {
+      printf ("iobench: exec failed\n");
+      return EXIT_FAILURE;
+    }
+  file_status = run_file ();
+  swap_status = wait (child);
+  printf ("iobench: file %s, swap %s\n",
+          file_status == EXIT_SUCCESS ? "ok" : "FAILED",
+          swap_status == EXIT_SUCCESS ? "ok" : "FAILED");
+  return file_status == EXIT_SUCCESS && swap_status == EXIT_SUCCESS
+         ? EXIT_SUCCESS : EXIT_FAILURE;
+}
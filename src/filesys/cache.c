@@ -7,6 +7,7 @@
 #include "devices/timer.h"
 #include "filesys/filesys.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
 
 struct cache_entry
 {
@@ -21,6 +22,15 @@ struct cache_entry
 	/* Indicate write back when cache flush or cache eviction .*/
 	bool dirty;
 
+	/* Whether the slot has been modified by the running journal
+	transaction. Such a slot must not be written back or evicted
+	before the transaction commits. See filesys/journal.c. */
+	bool logged;
+
+	/* Inode sector of the file whose data the slot holds, set 
+	when the slot is made dirty. Used by cache_flush_inode(). */
+	block_sector_t owner;
+
 	/* Whether this cache slot has data. */
 	/* Notice that the cache slot may have an valid sector number 
 	but has no data in it, which means the slot hasn't read data
@@ -89,6 +99,8 @@ void cache_init (void)
   	lock_init (&ce->has_data_lock);
   	ce->accessed = false;
   	ce->dirty = false;
+  	ce->logged = false;
+  	ce->owner = (block_sector_t) -1;
   	ce->has_data = false;
   	ce->waiters = 0;
   }
@@ -170,6 +182,8 @@ begin:
 		ce->sector = sector;
 		ce->accessed = false;
   	ce->dirty = false;
+  	ce->logged = false;
+  	ce->owner = (block_sector_t) -1;
   	ce->has_data = false;
   	ce->waiters = 0;
 
@@ -197,8 +211,9 @@ begin:
 			lock_release (&ce->l);
 			continue;
 		}
-		/* We don't evict this slot if it has waiters. */
-		else if (ce->waiters != 0)
+		/* We don't evict this slot if it has waiters 
+		or belongs to an uncommitted transaction. */
+		else if (ce->waiters != 0 || ce->logged)
 		{	
 			shared_lock_release (&ce->sl, true);
 			lock_release (&ce->l);
@@ -317,6 +332,12 @@ cache_dealloc (block_sector_t sector)
 			on this slot, or wait for it. */
 			ASSERT (shared_lock_try_acquire (&ce->sl, true))
 			ASSERT (ce->waiters == 0)
+			if (ce->logged)
+			{
+				/* Don't let the journal write it back later. */
+				journal_forget (sector);
+				ce->logged = false;
+			}
 			ce->sector = (block_sector_t) -1;
 			shared_lock_release (&ce->sl, true);
 			
@@ -329,14 +350,48 @@ cache_dealloc (block_sector_t sector)
 }
 
 /* Set the cache slot to be dirty */
+/* "owner" is the inode sector of the file the data belongs to. */
 void 
-cache_mark_dirty (struct cache_entry *ce)
+cache_mark_dirty (struct cache_entry *ce, block_sector_t owner)
 {	
 	ASSERT (ce->has_data);
 	ce->dirty = true;
+	ce->owner = owner;
+}
+
+/* Set the cache slot to be dirty and add it to the running
+journal transaction. Used for metadata. The caller must hold
+a write lock on the slot and be inside a journal handle. */
+void 
+cache_mark_logged (struct cache_entry *ce)
+{	
+	ASSERT (ce->has_data);
+	ce->dirty = true;
+	if (!ce->logged)
+	{
+		ce->logged = true;
+		journal_add (ce->sector);
+	}
+}
+
+/* Write the cache slot back to disk if it is dirty. */
+/* Used by the journal once the slot's transaction has committed. */
+/* The caller must have a write lock on the slot. */
+void
+cache_write_back (struct cache_entry *ce)
+{
+	if (ce->has_data && ce->dirty)
+	{
+		block_write (fs_device, ce->sector, ce->data);
+		ce->dirty = false;
+	}
+	ce->logged = false;
 }
 
 /* Flush dirty cache slot to disk */
+/* Commit the journal last, which writes back the logged slots.
+Data goes to disk before the metadata that points to it, so that
+a crash never leaves committed metadata pointing at stale data. */
 void
 cache_flush (void) 
 {
@@ -358,7 +413,7 @@ cache_flush (void)
 
    	lock_release (&ce->l);
     ce = cache_alloc_and_lock (sector, true);
-    if (ce->has_data && ce->dirty) 
+    if (ce->has_data && ce->dirty && !ce->logged) 
     {	
     	/* Need to write back if dirty. */
     	block_write (fs_device, ce->sector, ce->data);
@@ -366,6 +421,54 @@ cache_flush (void)
     }
     cache_unlock (ce, true);
   }
+  journal_commit ();
+}
+
+/* Write back the dirty data slots of the file whose inode is in
+sector "inumber", in ascending sector order. Then commits the
+journal, which writes back the file's inode and pointer blocks,
+so that they never point at data that isn't on disk yet. */
+void
+cache_flush_inode (block_sector_t inumber)
+{
+	block_sector_t sectors[CACHE_SIZE];
+	struct cache_entry *ce;
+	int cnt = 0;
+	int i, j;
+
+	/* Collect the file's dirty slots. */
+	for (i = 0; i < CACHE_SIZE; i++)
+	{
+		ce = &cache[i];
+		lock_acquire (&ce->l);
+		if (ce->sector != (block_sector_t) -1 && ce->owner == inumber
+				&& ce->dirty)
+			sectors[cnt++] = ce->sector;
+		lock_release (&ce->l);
+	}
+
+	/* Sort them, so the disk head sweeps once. */
+	for (i = 1; i < cnt; i++)
+	{
+		block_sector_t sector = sectors[i];
+		for (j = i; j > 0 && sectors[j - 1] > sector; j--)
+			sectors[j] = sectors[j - 1];
+		sectors[j] = sector;
+	}
+
+	for (i = 0; i < cnt; i++)
+	{
+		ce = cache_alloc_and_lock (sectors[i], true);
+		/* The slot may have been written back or reused meanwhile. */
+		if (ce->has_data && ce->dirty && !ce->logged && ce->owner == inumber)
+		{
+			block_write (fs_device, ce->sector, ce->data);
+			ce->dirty = false;
+		}
+		cache_unlock (ce, true);
+	}
+
+	journal_commit ();
 }
 
 /* Add sector to the read ahead list */
@@ -8,7 +8,10 @@ struct cache_entry* cache_alloc_and_lock (block_sector_t sector, bool exclusive)
 void cache_unlock (struct cache_entry *ce, bool exclusive);
 void* cache_get_data (struct cache_entry* ce, bool zero);
 void cache_dealloc (block_sector_t sector);
-void cache_mark_dirty (struct cache_entry *ce);
+void cache_mark_dirty (struct cache_entry *ce, block_sector_t owner);
+void cache_mark_logged (struct cache_entry *ce);
+void cache_write_back (struct cache_entry *ce);
 void cache_flush (void);
+void cache_flush_inode (block_sector_t inumber);
 void cache_readahead_add (block_sector_t sector);
 #endif
\ No newline at end of file
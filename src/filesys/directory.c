@@ -2,8 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <round.h>
+#include <dirent.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -21,6 +24,22 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Number of directory entries read by one inode_read_at()
+   call in dir_getdents(). */
+#define DIR_BATCH_CNT 16
+
+/* Most directory sectors the moves of one compact() call may
+   modify, counting both the sectors entries move into and the
+   ones they leave, and most sectors it may free.  Each freed
+   sector also
+   modifies a pointer block and a free map sector, and the inode
+   sector is modified once, so that a compaction stays within the
+   JOURNAL_CREDITS of one handle. */
+#define DIR_COMPACT_MAX_SECTORS 8
+#define DIR_COMPACT_MAX_FREE 3
+
+static void compact (struct dir *);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -88,12 +107,15 @@ dir_reopen (struct dir *dir)
   return dir_open (inode_reopen (dir->inode));
 }
 
-/* Destroys DIR and frees associated resources. */
+/* Destroys DIR and frees associated resources.
+   If this is the last opener of a directory that has collected
+   enough holes, compacts it first. */
 void
 dir_close (struct dir *dir) 
 {
   if (dir != NULL)
     {
+      compact (dir);
       inode_close (dir->inode);
       free (dir);
     }
@@ -110,28 +132,71 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   If SLOTS is non-null and either of its values is unknown, the
+   whole directory is scanned even after a match to rebuild
+   *SLOTS: the lowest free slot (the end of the directory if
+   there is none) and the number of free slots.  This lets
+   dir_add() check for a duplicate name and find a free slot in
+   one pass.  Known values are kept as they are. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, off_t *ofsp, struct dir_slots *slots) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_entry batch[DIR_BATCH_CNT];
+  off_t ofs = 0;
+  bool found = false;
+  bool count = (slots != NULL
+                && (slots->free_ofs < 0 || slots->free_cnt < 0));
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (count)
+    {
+      slots->free_ofs = -1;
+      slots->free_cnt = 0;
+    }
+
+  /* inode_read_at() will only return a short read at end of file.
+     Otherwise, we'd need to verify that we didn't get a short
+     read due to something intermittent such as low memory. */
+  for (;;)
+    {
+      int n = inode_read_at (dir->inode, batch, sizeof batch, ofs)
+              / (off_t) sizeof batch[0];
+      int i;
+
+      if (n == 0)
+        break;
+      for (i = 0; i < n; i++, ofs += sizeof batch[0])
+        {
+          struct dir_entry *e = &batch[i];
+          if (!e->in_use)
+            {
+              if (count)
+                {
+                  if (slots->free_ofs < 0)
+                    slots->free_ofs = ofs;
+                  slots->free_cnt++;
+                }
+            }
+          else if (!found && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              found = true;
+              if (!count)
+                return true;
+            }
+        }
+    }
+
+  if (count && slots->free_ofs < 0)
+    slots->free_ofs = ofs;
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -148,7 +213,7 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (name != NULL);
 
   inode_acquire_lock(dir->inode);
-  if (lookup (dir, name, &e, NULL))
+  if (lookup (dir, name, &e, NULL, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
@@ -167,6 +232,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  struct dir_slots *slots;
   off_t ofs;
   bool success = false;
 
@@ -177,22 +243,15 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
+  /* Check that NAME is not in use and set OFS to the offset of
+     a free slot in the same pass.  If there are no free slots,
+     then it will be set to the current end-of-file. */
+  journal_begin ();
   inode_acquire_lock(dir->inode);
-  if (lookup (dir, name, NULL, NULL))
+  slots = inode_dir_slots (dir->inode);
+  if (lookup (dir, name, NULL, NULL, slots))
     goto done;
-
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  ofs = slots->free_ofs;
 
   /* Write slot. */
   e.in_use = true;
@@ -200,8 +259,19 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* If we filled a hole, the next one is not known until the
+     next scan. */
+  if (success && slots->free_cnt > 0)
+    {
+      slots->free_cnt--;
+      slots->free_ofs = -1;
+    }
+  else if (success)
+    slots->free_ofs = ofs + sizeof e;
+
  done:
   inode_release_lock(dir->inode);
+  journal_end ();
   return success;
 }
 
@@ -212,6 +282,7 @@ bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
+  struct dir_slots *slots;
   struct inode *inode = NULL;
   bool success = false;
   off_t ofs;
@@ -222,10 +293,12 @@ dir_remove (struct dir *dir, const char *name)
   if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
     return false;
 
+  journal_begin ();
   inode_acquire_lock(dir->inode);
+  slots = inode_dir_slots (dir->inode);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &ofs, NULL))
     goto done;
   /* Open inode. */
   inode = inode_open (e.inode_sector);
@@ -256,6 +329,13 @@ dir_remove (struct dir *dir, const char *name)
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
+  /* Remember the hole for dir_close(), unless the counts are
+     unknown anyway. */
+  if (slots->free_cnt >= 0)
+    slots->free_cnt++;
+  if (slots->free_ofs >= 0 && ofs < slots->free_ofs)
+    slots->free_ofs = ofs;
+
   /* Remove inode. */
   inode_remove (inode);
   success = true;
@@ -263,6 +343,7 @@ dir_remove (struct dir *dir, const char *name)
  done:
   inode_release_lock(dir->inode);
   inode_close (inode);
+  journal_end ();
   return success;
 }
 
@@ -290,3 +371,196 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   inode_release_lock(dir->inode);
   return false;
 }
+
+/* Reads as many of the remaining entries of DIR as fit into the
+   CNT elements of ENTS, skipping "." and "..".  Fills in the name,
+   inode number and type of each entry.  Returns the number of
+   entries stored, 0 if the directory contains no more entries. */
+int
+dir_getdents (struct dir *dir, struct dirent *ents, int cnt)
+{
+  struct dir_entry batch[DIR_BATCH_CNT];
+  int filled = 0;
+
+  if (dir == NULL)
+    return 0;
+  inode_acquire_lock(dir->inode);
+  while (filled < cnt)
+    {
+      /* Read a run of entries at once instead of one at a time. */
+      off_t bytes = inode_read_at (dir->inode, batch, sizeof batch, dir->pos);
+      int n = bytes / (off_t) sizeof batch[0];
+      int i;
+
+      if (n == 0)
+        break;
+      for (i = 0; i < n && filled < cnt; i++)
+        {
+          struct dir_entry *e = &batch[i];
+          struct inode *inode;
+
+          dir->pos += sizeof *e;
+          if (!e->in_use || !strcmp (e->name, ".") || !strcmp (e->name, ".."))
+            continue;
+
+          ents[filled].inumber = e->inode_sector;
+          inode = inode_open (e->inode_sector);
+          ents[filled].is_dir = inode_is_dir (inode);
+          inode_close (inode);
+          strlcpy (ents[filled].name, e->name, sizeof ents[filled].name);
+          filled++;
+        }
+    }
+  inode_release_lock(dir->inode);
+  return filled;
+}
+
+/* Reads the entry of DIR at OFS into *E.
+   Returns true if it is in use. */
+static bool
+slot_in_use (struct dir *dir, off_t ofs, struct dir_entry *e)
+{
+  return (inode_read_at (dir->inode, e, sizeof *e, ofs) == sizeof *e
+          && e->in_use);
+}
+
+/* Widens the range of sectors *FIRST...*LAST, which is empty if
+   *LAST < *FIRST, to cover the directory entry at OFS.  Returns
+   the number of sectors added. */
+static int
+cover (off_t ofs, off_t *first, off_t *last)
+{
+  off_t start = ofs / BLOCK_SECTOR_SIZE;
+  off_t end = (ofs + sizeof (struct dir_entry) - 1) / BLOCK_SECTOR_SIZE;
+  int cnt = 0;
+
+  if (*last < *first)
+    {
+      *first = start;
+      *last = end;
+      return end - start + 1;
+    }
+  if (start < *first)
+    {
+      cnt += *first - start;
+      *first = start;
+    }
+  if (end > *last)
+    {
+      cnt += end - *last;
+      *last = end;
+    }
+  return cnt;
+}
+
+/* Moves the last entries of DIR into the holes left by
+   dir_remove() and shrinks the directory file, so that later
+   scans get shorter.  Only worth doing once the holes add up to
+   at least one sector.  Does nothing unless DIR is the only
+   opener of its inode, since moving entries would confuse the
+   position of other readers.  Moves modify at most
+   DIR_COMPACT_MAX_SECTORS sectors and it frees at most
+   DIR_COMPACT_MAX_FREE sectors; the rest waits for a later
+   close. */
+static void
+compact (struct dir *dir)
+{
+  struct dir_slots *slots;
+  struct dir_entry e;
+  off_t lo, hi, length, old_sectors;
+  off_t dst_first = 0, dst_last = -1, src_first = 0, src_last = -1;
+  int sector_cnt = 0;
+  bool holes_left;
+
+  ASSERT (DIR_COMPACT_MAX_SECTORS + 2 * DIR_COMPACT_MAX_FREE + 1
+          <= JOURNAL_CREDITS);
+
+  /* Unlocked hint, so that closes of a shared directory don't
+     start a journal handle.  Repeated below under the lock. */
+  if (inode_open_cnt (dir->inode) != 1)
+    return;
+
+  /* Openers that come after the test below start at position 0
+     and can't read entries until the lock is released, so the
+     moves can't confuse them. */
+  journal_begin ();
+  inode_acquire_lock (dir->inode);
+  slots = inode_dir_slots (dir->inode);
+  if (inode_open_cnt (dir->inode) != 1 || slots->free_cnt < 0
+      || slots->free_cnt * (off_t) sizeof e < BLOCK_SECTOR_SIZE)
+    {
+      inode_release_lock (dir->inode);
+      journal_end ();
+      return;
+    }
+
+  /* Fill the lowest hole with the highest entry until the two
+     meet.  "." and ".." are never free, so they never move. */
+  lo = 0;
+  hi = inode_length (dir->inode) - sizeof e;
+  for (;;)
+    {
+      while (lo < hi && slot_in_use (dir, lo, &e))
+        lo += sizeof e;
+      while (hi > lo && !slot_in_use (dir, hi, &e))
+        hi -= sizeof e;
+      if (lo >= hi)
+        break;
+
+      /* LO only grows and HI only shrinks, so each side's
+         sectors form one range.  A sector on both sides is
+         counted twice. */
+      sector_cnt += cover (lo, &dst_first, &dst_last);
+      sector_cnt += cover (hi, &src_first, &src_last);
+      if (sector_cnt > DIR_COMPACT_MAX_SECTORS)
+        break;
+
+      /* E now holds the entry at HI.  Everything above HI is
+         either free or has already been moved down.  The old
+         slot is freed, since the truncation below may keep it. */
+      if (inode_write_at (dir->inode, &e, sizeof e, lo) != sizeof e)
+        break;
+      e.in_use = false;
+      if (inode_write_at (dir->inode, &e, sizeof e, hi) != sizeof e)
+        break;
+      lo += sizeof e;
+      hi -= sizeof e;
+    }
+
+  holes_left = lo < hi;
+  if (holes_left)
+    length = hi + sizeof e;
+  else
+    {
+      length = lo;
+      if (lo == hi && slot_in_use (dir, lo, &e))
+        length += sizeof e;
+    }
+
+  /* Free at most DIR_COMPACT_MAX_FREE sectors, keeping the length
+     a whole number of entries.  The free entries left at the end
+     count as holes. */
+  old_sectors = DIV_ROUND_UP (inode_length (dir->inode), BLOCK_SECTOR_SIZE);
+  if (old_sectors - DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE)
+      > DIR_COMPACT_MAX_FREE)
+    {
+      length = ROUND_UP ((old_sectors - DIR_COMPACT_MAX_FREE)
+                         * BLOCK_SECTOR_SIZE, sizeof e);
+      holes_left = true;
+    }
+  inode_truncate (dir->inode, length);
+
+  if (holes_left)
+    {
+      /* Holes are left, the next scan will count them. */
+      slots->free_cnt = -1;
+      slots->free_ofs = -1;
+    }
+  else
+    {
+      slots->free_cnt = 0;
+      slots->free_ofs = length;
+    }
+  inode_release_lock (dir->inode);
+  journal_end ();
+}
@@ -7,6 +7,7 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 #include "threads/thread.h"
 
 /* Partition that contains the file system. */
@@ -29,6 +30,7 @@ filesys_init (bool format)
 
   inode_init ();
   cache_init ();
+  journal_init (format);
   free_map_init ();
 
   if (format) 
@@ -180,8 +182,13 @@ filesys_create (const char *name_, off_t initial_size, bool isdir)
   struct inode *inode = NULL;
   char file_name[NAME_MAX+1];
   struct dir *dir = get_directory_from_path(file_name, name);
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector));
+  bool success;
+
+  /* Allocating, initializing and linking the inode commit
+     together. */
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector));
   if (success)
   {
     if (isdir)
@@ -210,6 +217,7 @@ filesys_create (const char *name_, off_t initial_size, bool isdir)
       success = false;
     }
   }
+  journal_end ();
 
   dir_close (dir);
   return success;
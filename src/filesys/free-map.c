@@ -5,6 +5,7 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
@@ -18,24 +19,31 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTOR_CNT, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.
+   Only the part of the free map that changed is written, and
+   the write is part of the running journal transaction. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector;
+
+  journal_begin ();
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+      && !bitmap_write_range (free_map, free_map_file, sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
+  journal_end ();
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
@@ -46,8 +54,10 @@ void
 free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
+  journal_begin ();
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  bitmap_write_range (free_map, free_map_file, sector, cnt);
+  journal_end ();
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -75,6 +85,7 @@ free_map_create (void)
 {
   /* Create inode. */
   bool success;
+  size_t ofs;
   struct inode *inode = inode_create (FREE_MAP_SECTOR, false);  
   if (inode != NULL)
     success = inode_write_at (inode, "\0", 1, bitmap_file_size (free_map) - 1) == 1;
@@ -84,10 +95,17 @@ free_map_create (void)
   if (!success)
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write bitmap to file, one sector's worth of bits at a time
+     so that each write fits in a journal transaction. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
-    PANIC ("can't write free map");
+  for (ofs = 0; ofs < bitmap_size (free_map); ofs += BLOCK_SECTOR_SIZE * 8)
+    {
+      size_t cnt = bitmap_size (free_map) - ofs;
+      if (cnt > BLOCK_SECTOR_SIZE * 8)
+        cnt = BLOCK_SECTOR_SIZE * 8;
+      if (!bitmap_write_range (free_map, free_map_file, ofs, cnt))
+        PANIC ("can't write free map");
+    }
 }
@@ -7,8 +7,12 @@
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/pagecache.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -55,7 +59,9 @@ struct inode
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool journaled;                     /* Are data writes journaled? */
     struct lock inode_lock;             /* Lock used for directory. */
+    struct dir_slots slots;             /* Free slot hint for directory. */
 
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct lock dw_lock;                /* Lock for deny write. */
@@ -90,12 +96,13 @@ inode_create (block_sector_t sector, bool is_dir)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  journal_begin ();
   ce = cache_alloc_and_lock (sector, true);
   disk_inode = cache_get_data (ce, true);
   disk_inode->length = 0;
   disk_inode->type = is_dir ? 1 : 0; 
   disk_inode->magic = INODE_MAGIC;
-  cache_mark_dirty (ce);
+  cache_mark_logged (ce);
   cache_unlock (ce, true);
 
   struct inode* inode = inode_open (sector);
@@ -104,6 +111,7 @@ inode_create (block_sector_t sector, bool is_dir)
     cache_dealloc (sector);
     free_map_release (sector, 1);
   }
+  journal_end ();
   return inode;
 }
 
@@ -165,7 +173,11 @@ inode_open (block_sector_t sector)
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->removed = false;
+  /* Directory contents and the free map are metadata. */
+  inode->journaled = sector == FREE_MAP_SECTOR || inode_is_dir (inode);
   lock_init (&inode->inode_lock);
+  inode->slots.free_ofs = -1;
+  inode->slots.free_cnt = -1;
 
   inode->deny_write_cnt = 0;
   lock_init (&inode->dw_lock);
@@ -186,6 +198,15 @@ void inode_release_lock(struct inode *inode)
   lock_release (&inode->inode_lock);
 }
 
+/* Returns the free slot hint of directory INODE.
+   The caller must hold INODE's lock. */
+struct dir_slots *
+inode_dir_slots (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode->inode_lock));
+  return &inode->slots;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
@@ -211,6 +232,7 @@ inode_get_inumber (const struct inode *inode)
 static void
 remove_inode (struct inode *inode)
 { 
+  journal_begin ();
   struct cache_entry *ce = cache_alloc_and_lock (inode->sector, true);
   struct inode_disk *disk_inode = cache_get_data (ce, false);
   int i;
@@ -290,6 +312,7 @@ remove_inode (struct inode *inode)
   cache_unlock (ce, true);
   cache_dealloc (inode->sector);
   free_map_release (inode->sector,1);
+  journal_end ();
   return;
 }
 
@@ -330,25 +353,14 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
-/* Gets the cache slot for the given byte OFFSET in INODE,
-   setting *"ce_result" to the result.
-   Returns true if successful, false on failure.
-   If "is_write" is false, then missing sector will be successful
-   with *"ce_result" set to a null pointer. This means we support 
-   sparse file.
-   If "is_write" is true, then missing sector will be allocated.
-   The cache slot returned will be locked, exclusively if "is_write" is
-   true, or non-exclusively if "is_write" is false. */
-static bool
-read_block (struct inode *inode, off_t offset, 
-  bool is_write, struct cache_entry **ce_result) 
+/* Translates byte OFFSET in an inode into the index of the
+   pointer to follow at each level of the inode's tree, storing
+   them into SECTOR_OFFS.  Returns the number of levels: 1 for a
+   direct block, 2 for an indirect block and 3 for a double
+   indirect block. */
+static int
+offset_to_path (off_t offset, off_t sector_offs[3])
 {
-  ASSERT (inode != NULL);
-  ASSERT (offset >= 0);
-  ASSERT (offset <= (off_t) INODE_MAX_LENGTH);
-
-  /* First calculate offsets in different levels. */
-  off_t sector_offs[3];
   int level;
   
   off_t sector_off = offset / BLOCK_SECTOR_SIZE;
@@ -380,6 +392,29 @@ read_block (struct inode *inode, off_t offset,
       level = 3;
     }
   }    
+  return level;
+}
+
+/* Gets the cache slot for the given byte OFFSET in INODE,
+   setting *"ce_result" to the result.
+   Returns true if successful, false on failure.
+   If "is_write" is false, then missing sector will be successful
+   with *"ce_result" set to a null pointer. This means we support 
+   sparse file.
+   If "is_write" is true, then missing sector will be allocated.
+   The cache slot returned will be locked, exclusively if "is_write" is
+   true, or non-exclusively if "is_write" is false. */
+static bool
+read_block (struct inode *inode, off_t offset, 
+  bool is_write, struct cache_entry **ce_result) 
+{
+  ASSERT (inode != NULL);
+  ASSERT (offset >= 0);
+  ASSERT (offset <= (off_t) INODE_MAX_LENGTH);
+
+  /* First calculate offsets in different levels. */
+  off_t sector_offs[3];
+  int level = offset_to_path (offset, sector_offs);
 
   int this_level = 0;
   block_sector_t sector = inode->sector;
@@ -428,7 +463,9 @@ read_block (struct inode *inode, off_t offset,
       return true;
     }
 
-    /* We need to allocate a new sector. */
+    /* We need to allocate a new sector.  The pointer update is
+       logged; the handle must be started before locking. */
+    journal_begin ();
     ce = cache_alloc_and_lock (sector, true);
     data = cache_get_data (ce, false);
 
@@ -437,6 +474,7 @@ read_block (struct inode *inode, off_t offset,
     if (*next_sector != 0)
     { 
       cache_unlock (ce, true);
+      journal_end ();
       continue;
     }
 
@@ -444,17 +482,24 @@ read_block (struct inode *inode, off_t offset,
     if (!free_map_allocate (1, next_sector))
     {
       cache_unlock (ce, true);
+      journal_end ();
       *ce_result = NULL;
       return false;
     }
 
-    cache_mark_dirty (ce);
+    cache_mark_logged (ce);
 
     next_ce = cache_alloc_and_lock (*next_sector, true);
     /* Zero out the new sector. */
     cache_get_data (next_ce, true);
+    /* Pointer blocks and metadata file contents are logged too. */
+    if (this_level < level - 1 || inode->journaled)
+      cache_mark_logged (next_ce);
+    else
+      cache_mark_dirty (next_ce, inode->sector);
 
     cache_unlock (ce, true);
+    journal_end ();
 
     /* If this is the final level, return the new sector. */
     if (this_level == level - 1) 
@@ -497,6 +542,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
+#ifdef VM
+      /* A process may have modified the page through mmap. */
+      if (pagecache_read (inode, offset, buffer + bytes_read, chunk_size))
+        {
+          size -= chunk_size;
+          offset += chunk_size;
+          bytes_read += chunk_size;
+          continue;
+        }
+#endif
+
       struct cache_entry *ce;
       if (!read_block (inode, offset, false, &ce))
         break;
@@ -533,11 +589,18 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
 
+  /* Writes to metadata files are a single journal transaction.
+     Otherwise only block allocation and the length are logged. */
+  if (inode->journaled)
+    journal_begin ();
+
   /* Check whether write is allowed. */
   lock_acquire (&inode->dw_lock);
   if (inode->deny_write_cnt > 0) 
   {
     lock_release (&inode->dw_lock);
+    if (inode->journaled)
+      journal_end ();
     return 0;
   }
 
@@ -559,14 +622,28 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
+#ifdef VM
+      /* Show the new data to processes mapping it, before the
+         buffer cache, so that writing their frame back can't
+         undo the write. */
+      pagecache_write (inode, offset, buffer + bytes_written, chunk_size);
+#endif
+
       struct cache_entry *ce;
       if (!read_block (inode, offset, true, &ce))
         break;
 
       uint8_t *data = cache_get_data (ce, false);
       memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
-      cache_mark_dirty (ce);
+      if (inode->journaled)
+        cache_mark_logged (ce);
+      else
+        cache_mark_dirty (ce, inode->sector);
       cache_unlock (ce, true);
+#ifdef VM
+      /* And after, for a page read in from the old data meanwhile. */
+      pagecache_write (inode, offset, buffer + bytes_written, chunk_size);
+#endif
 
       /* Advance. */
       size -= chunk_size;
@@ -575,14 +652,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     }
 
   /* Extend File. */
+  journal_begin ();
   struct cache_entry *ce1 = cache_alloc_and_lock (inode->sector, true);
   struct inode_disk *disk_inode1 = cache_get_data (ce1, false);
   if (offset > disk_inode1->length) 
   {
     disk_inode1->length = offset;
-    cache_mark_dirty (ce1);
+    cache_mark_logged (ce1);
   }
   cache_unlock (ce1, true);
+  journal_end ();
 
   /* Finish writing, others can deny write now. */
   lock_acquire (&inode->dw_lock);
@@ -590,9 +669,90 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     cond_signal (&inode->no_writers, &inode->dw_lock);
   lock_release (&inode->dw_lock);
 
+  if (inode->journaled)
+    journal_end ();
   return bytes_written;
 }
 
+/* Frees the data sector that holds byte OFFSET in INODE, if it
+   is allocated, and clears the pointer to it.  Pointer blocks are
+   kept; remove_inode() frees them along with the inode. */
+static void
+release_block (struct inode *inode, off_t offset)
+{
+  off_t sector_offs[3];
+  int level = offset_to_path (offset, sector_offs);
+  block_sector_t sector = inode->sector;
+  int this_level;
+
+  journal_begin ();
+  for (this_level = 0; ; this_level++)
+  {
+    bool is_last = this_level == level - 1;
+    struct cache_entry *ce = cache_alloc_and_lock (sector, is_last);
+    uint32_t *data = cache_get_data (ce, false);
+    block_sector_t next_sector = data[sector_offs[this_level]];
+
+    if (next_sector == 0)
+    {
+      /* Sparse, nothing to free. */
+      cache_unlock (ce, is_last);
+      journal_end ();
+      return;
+    }
+
+    if (is_last)
+    {
+      data[sector_offs[this_level]] = 0;
+      cache_mark_logged (ce);
+      cache_unlock (ce, true);
+      cache_dealloc (next_sector);
+      free_map_release (next_sector, 1);
+      journal_end ();
+      return;
+    }
+
+    cache_unlock (ce, false);
+    sector = next_sector;
+  }
+}
+
+/* Shrinks INODE to LENGTH bytes and frees the data sectors past
+   the new end of file.  Does nothing if INODE is not longer than
+   LENGTH.  The caller must make sure nobody else reads or writes
+   INODE meanwhile. */
+void
+inode_truncate (struct inode *inode, off_t length)
+{
+  ASSERT (inode != NULL);
+  ASSERT (length >= 0);
+
+  journal_begin ();
+  struct cache_entry *ce = cache_alloc_and_lock (inode->sector, true);
+  struct inode_disk *disk_inode = cache_get_data (ce, false);
+  off_t old_length = disk_inode->length;
+  if (length < old_length)
+  {
+    disk_inode->length = length;
+    cache_mark_logged (ce);
+  }
+  cache_unlock (ce, true);
+
+  size_t i;
+  for (i = bytes_to_sectors (length); i < bytes_to_sectors (old_length); i++)
+    release_block (inode, i * BLOCK_SECTOR_SIZE);
+  journal_end ();
+}
+
+/* Writes INODE's modified data, pointer blocks and inode sector
+   to disk. */
+void
+inode_flush (struct inode *inode)
+{
+  ASSERT (inode != NULL);
+  cache_flush_inode (inode->sector);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
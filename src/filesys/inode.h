@@ -23,4 +23,18 @@ void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 void inode_acquire_lock(struct inode *);
 void inode_release_lock(struct inode *);
+void inode_truncate (struct inode *, off_t length);
+void inode_flush (struct inode *);
+
+/* In-memory free slot bookkeeping of a directory inode.
+   Owned by filesys/directory.c and protected by the inode lock.
+   A negative value means "unknown", to be rebuilt by the next
+   full scan of the directory. */
+struct dir_slots
+  {
+    off_t free_ofs;             /* Offset of the lowest free slot. */
+    int free_cnt;               /* Number of free slots. */
+  };
+
+struct dir_slots *inode_dir_slots (struct inode *);
 #endif /* filesys/inode.h */
@@ -0,0 +1,276 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Inode sectors, pointer blocks, directory blocks and free map
+   blocks are "logged": a thread that modifies them must do so
+   between journal_begin() and journal_end(), and the cache keeps
+   the modified slots from being written back until the running
+   transaction commits.  Several operations share one transaction
+   (group commit).  A commit writes the images of all logged
+   sectors to the journal region, then a commit record, then the
+   sectors to their home locations, and finally empties the
+   journal.  If the machine stops in between, journal_init()
+   finds the commit record at the next boot and replays the
+   images, so each transaction hits the disk entirely or not at
+   all. */
+
+/* Identifies a journal descriptor or commit record. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Most sectors one transaction may log.  Must stay well below
+   CACHE_SIZE, because logged slots can't be evicted. */
+#define JOURNAL_MAX_BLOCKS 48
+
+/* On-disk journal descriptor, stored at JOURNAL_SECTOR.
+   Followed by CNT sector images and a commit record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_desc
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of logged sectors. */
+    block_sector_t sectors[BLOCK_SECTOR_SIZE / sizeof (block_sector_t) - 3];
+  };
+
+/* On-disk commit record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_commit
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Matches the descriptor. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8];
+  };
+
+/* The running transaction. */
+static block_sector_t logged[JOURNAL_MAX_BLOCKS]; /* Logged sectors. */
+static int logged_cnt;                  /* Number of logged sectors. */
+static uint32_t seq;                    /* Sequence number of last commit. */
+
+static int active_cnt;                  /* Number of open outermost handles. */
+static int reserved_cnt;                /* Credits held by open handles. */
+static bool committing;                 /* Is a commit in progress? */
+
+/* Protects all of the above. */
+static struct lock journal_lock;
+/* Signaled when a handle ends. */
+static struct condition no_handles;
+/* Signaled when a commit completes. */
+static struct condition commit_done;
+
+static void write_desc (uint32_t cnt);
+static void replay (void);
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   journal, otherwise replays the committed transaction left in
+   the journal, if any. */
+void
+journal_init (bool format)
+{
+  lock_init (&journal_lock);
+  cond_init (&no_handles);
+  cond_init (&commit_done);
+  logged_cnt = 0;
+  active_cnt = 0;
+  reserved_cnt = 0;
+  committing = false;
+  seq = 0;
+
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_commit) == BLOCK_SECTOR_SIZE);
+  ASSERT (JOURNAL_SECTOR_CNT >= JOURNAL_MAX_BLOCKS + 2);
+
+  if (!format)
+    replay ();
+  write_desc (0);
+}
+
+/* Starts a handle: the calling thread is about to modify logged
+   sectors.  Handles nest; only the outermost one counts.  May
+   wait for a commit, so the caller must not hold any file system
+   lock. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+  if (t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing
+         || logged_cnt + reserved_cnt + JOURNAL_CREDITS > JOURNAL_MAX_BLOCKS)
+    {
+      if (!committing && active_cnt == 0)
+        {
+          /* Transaction is full and idle, commit it ourselves. */
+          t->journal_depth--;
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+          t->journal_depth++;
+        }
+      else
+        cond_wait (committing ? &commit_done : &no_handles, &journal_lock);
+    }
+  active_cnt++;
+  reserved_cnt += JOURNAL_CREDITS;
+  lock_release (&journal_lock);
+}
+
+/* Ends the handle started by the matching journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  active_cnt--;
+  reserved_cnt -= JOURNAL_CREDITS;
+  cond_broadcast (&no_handles, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR to the running transaction.
+   Called by the cache the first time a slot is logged. */
+void
+journal_add (block_sector_t sector)
+{
+  ASSERT (thread_current ()->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  if (logged_cnt >= JOURNAL_MAX_BLOCKS)
+    PANIC ("journal transaction overflow");
+  logged[logged_cnt++] = sector;
+  lock_release (&journal_lock);
+}
+
+/* Drops SECTOR from the running transaction, because it has
+   been freed.  Otherwise replaying the transaction could
+   overwrite the sector after it has been reused. */
+void
+journal_forget (block_sector_t sector)
+{
+  int i;
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < logged_cnt; i++)
+    if (logged[i] == sector)
+      {
+        logged[i] = logged[--logged_cnt];
+        break;
+      }
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, waiting for open handles to
+   end first.  Returns once all logged sectors are on disk at
+   their home locations. */
+void
+journal_commit (void)
+{
+  static struct journal_commit rec;
+  int i;
+
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_done, &journal_lock);
+  if (logged_cnt == 0)
+    {
+      lock_release (&journal_lock);
+      return;
+    }
+  committing = true;
+  while (active_cnt > 0)
+    cond_wait (&no_handles, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* No handle is open and new ones wait for us, so the logged
+     sectors can't change under us. */
+
+  /* Log the sector images, then the descriptor and commit
+     record.  The commit record makes the transaction durable. */
+  for (i = 0; i < logged_cnt; i++)
+    {
+      struct cache_entry *ce = cache_alloc_and_lock (logged[i], false);
+      block_write (fs_device, JOURNAL_SECTOR + 1 + i, cache_get_data (ce, false));
+      cache_unlock (ce, false);
+    }
+  seq++;
+  write_desc (logged_cnt);
+  memset (&rec, 0, sizeof rec);
+  rec.magic = JOURNAL_MAGIC;
+  rec.seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR + 1 + logged_cnt, &rec);
+
+  /* Checkpoint: write the sectors home and release them to the
+     cache, then empty the journal. */
+  for (i = 0; i < logged_cnt; i++)
+    {
+      struct cache_entry *ce = cache_alloc_and_lock (logged[i], true);
+      cache_write_back (ce);
+      cache_unlock (ce, true);
+    }
+  write_desc (0);
+
+  lock_acquire (&journal_lock);
+  logged_cnt = 0;
+  committing = false;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Writes a descriptor for the running transaction, listing its
+   first CNT logged sectors, at JOURNAL_SECTOR. */
+static void
+write_desc (uint32_t cnt)
+{
+  static struct journal_desc desc;
+  uint32_t i;
+
+  memset (&desc, 0, sizeof desc);
+  desc.magic = JOURNAL_MAGIC;
+  desc.seq = seq;
+  desc.cnt = cnt;
+  for (i = 0; i < cnt; i++)
+    desc.sectors[i] = logged[i];
+  block_write (fs_device, JOURNAL_SECTOR, &desc);
+}
+
+/* Copies the sector images of a committed but not checkpointed
+   transaction to their home locations. */
+static void
+replay (void)
+{
+  static struct journal_desc desc;
+  static struct journal_commit rec;
+  static uint8_t buf[BLOCK_SECTOR_SIZE];
+  uint32_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, &desc);
+  if (desc.magic != JOURNAL_MAGIC)
+    PANIC ("no journal found, file system must be reformatted");
+  seq = desc.seq;
+  if (desc.cnt == 0 || desc.cnt > JOURNAL_MAX_BLOCKS)
+    return;
+
+  block_read (fs_device, JOURNAL_SECTOR + 1 + desc.cnt, &rec);
+  if (rec.magic != JOURNAL_MAGIC || rec.seq != desc.seq)
+    return;
+
+  for (i = 0; i < desc.cnt; i++)
+    {
+      block_read (fs_device, JOURNAL_SECTOR + 1 + i, buf);
+      block_write (fs_device, desc.sectors[i], buf);
+    }
+}
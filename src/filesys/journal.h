@@ -0,0 +1,18 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Sectors reserved by each outermost handle.  No single file
+   system operation logs more sectors than this. */
+#define JOURNAL_CREDITS 16
+
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_add (block_sector_t sector);
+void journal_forget (block_sector_t sector);
+void journal_commit (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Maximum length of a file name in a directory entry.
+   Must match NAME_MAX in filesys/directory.h. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry as returned by the getdents system call.
+   Shared between the kernel and user programs. */
+struct dirent
+  {
+    int inumber;                        /* Inode number of the entry. */
+    bool is_dir;                        /* Is the entry a directory? */
+    char name[DIRENT_NAME_MAX + 1];     /* Null terminated file name. */
+  };
+
+#endif /* lib/dirent.h */
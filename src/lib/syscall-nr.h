@@ -28,7 +28,16 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+    SYS_GETDENTS,               /* Reads several directory entries. */
+    SYS_FSYNC,                  /* Writes a file's modified data to disk. */
+    SYS_SYNC,                   /* Writes all modified data to disk. */
+    SYS_FORK,                   /* Copy this process. */
+    SYS_MSYNC                   /* Write a memory mapping back to its file. */
   };
 
+/* Flags for SYS_MSYNC. */
+#define MS_ASYNC 1              /* Leave it to the kernel's flusher. */
+#define MS_SYNC 4               /* Write back before returning. */
+
 #endif /* lib/syscall-nr.h */
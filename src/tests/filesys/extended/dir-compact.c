@@ -0,0 +1,88 @@
+/* Creates a directory that spans several sectors, removes most
+   of its entries while holding it open, and closes it so that
+   it gets compacted.  Checks that each remaining file is listed
+   exactly once and can be removed and created again. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+#define KEEP_STEP 20
+#define BATCH_CNT 8
+
+/* Lists "a" and checks that it holds each kept file once. */
+static void
+check_listing (void)
+{
+  struct dirent ents[BATCH_CNT];
+  bool seen[FILE_CNT];
+  int total = 0;
+  int fd, cnt, i;
+
+  memset (seen, 0, sizeof seen);
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  while ((cnt = getdents (fd, ents, BATCH_CNT)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        int n;
+        if (ents[i].name[0] != 'f' || (n = atoi (ents[i].name + 1)) < 0
+            || n >= FILE_CNT || n % KEEP_STEP != 0)
+          fail ("getdents returned unexpected name \"%s\"", ents[i].name);
+        if (seen[n])
+          fail ("getdents returned \"%s\" twice", ents[i].name);
+        seen[n] = true;
+        total++;
+      }
+  CHECK (total == FILE_CNT / KEEP_STEP, "listed %d files (must be %d)",
+         total, FILE_CNT / KEEP_STEP);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  int fd, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  msg ("create %d files in \"a\"", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, "a/f%d", i);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+    }
+  quiet = false;
+
+  /* Keep "a" open, so that it is compacted only once at the end,
+     with holes scattered over all of its sectors. */
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  msg ("remove all but every %dth file", KEEP_STEP);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    if (i % KEEP_STEP != 0)
+      {
+        snprintf (file_name, sizeof file_name, "a/f%d", i);
+        CHECK (remove (file_name), "remove \"%s\"", file_name);
+      }
+  quiet = false;
+  msg ("close \"a\"");
+  close (fd);
+  check_listing ();
+
+  msg ("remove and create the remaining files again");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += KEEP_STEP)
+    {
+      snprintf (file_name, sizeof file_name, "a/f%d", i);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+      CHECK (!remove (file_name), "remove \"%s\" again", file_name);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+    }
+  quiet = false;
+  check_listing ();
+}
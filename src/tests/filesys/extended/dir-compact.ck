@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-compact) begin
+(dir-compact) mkdir "a"
+(dir-compact) create 200 files in "a"
+(dir-compact) open "a"
+(dir-compact) remove all but every 20th file
+(dir-compact) close "a"
+(dir-compact) open "a"
+(dir-compact) listed 10 files (must be 10)
+(dir-compact) remove and create the remaining files again
+(dir-compact) open "a"
+(dir-compact) listed 10 files (must be 10)
+(dir-compact) end
+dir-compact: exit(0)
+EOF
+pass;
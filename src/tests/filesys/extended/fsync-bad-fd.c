@@ -0,0 +1,16 @@
+/* Calls fsync() on file descriptors that are not open, which
+   must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fds[] = {-1, 0, 1, 5, 0x20101234};
+  size_t i;
+
+  for (i = 0; i < sizeof fds / sizeof *fds; i++) 
+    CHECK (!fsync (fds[i]), "fsync fd %d (must return false)", fds[i]);
+}
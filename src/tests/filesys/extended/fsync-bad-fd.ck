@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(fsync-bad-fd) begin
+(fsync-bad-fd) fsync fd -1 (must return false)
+(fsync-bad-fd) fsync fd 0 (must return false)
+(fsync-bad-fd) fsync fd 1 (must return false)
+(fsync-bad-fd) fsync fd 5 (must return false)
+(fsync-bad-fd) fsync fd 537989684 (must return false)
+(fsync-bad-fd) end
+fsync-bad-fd: exit(0)
+EOF
+(fsync-bad-fd) begin
+fsync-bad-fd: exit(-1)
+EOF
+pass;
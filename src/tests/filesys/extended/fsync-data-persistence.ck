@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'fsynced' => ['abcdefghij' x 300],
+		'synced' => ['0123456789' x 300]});
+pass;
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync-data) begin
+(fsync-data) create "fsynced"
+(fsync-data) open "fsynced"
+(fsync-data) write "fsynced"
+(fsync-data) fsync "fsynced"
+(fsync-data) create "synced"
+(fsync-data) open "synced"
+(fsync-data) write "synced"
+(fsync-data) sync
+(fsync-data) end
+fsync-data: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Creates a file in a new directory, then calls fsync() on the
+   directory. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/b", 512), "create \"a/b\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (fsync (fd), "fsync \"a\"");
+  close (fd);
+}
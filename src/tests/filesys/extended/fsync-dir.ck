@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync-dir) begin
+(fsync-dir) mkdir "a"
+(fsync-dir) create "a/b"
+(fsync-dir) open "a"
+(fsync-dir) fsync "a"
+(fsync-dir) end
+fsync-dir: exit(0)
+EOF
+pass;
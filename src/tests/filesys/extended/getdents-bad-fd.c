@@ -0,0 +1,21 @@
+/* Calls getdents() on file descriptors that are not open, which
+   must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct dirent ent;
+  int fds[] = {-1, 0, 1, 5, 0x20101234};
+  size_t i;
+
+  for (i = 0; i < sizeof fds / sizeof *fds; i++) 
+    {
+      int retval = getdents (fds[i], &ent, 1);
+      CHECK (retval == -1, "getdents fd %d (must return -1, actually %d)",
+             fds[i], retval);
+    }
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(getdents-bad-fd) begin
+(getdents-bad-fd) getdents fd -1 (must return -1, actually -1)
+(getdents-bad-fd) getdents fd 0 (must return -1, actually -1)
+(getdents-bad-fd) getdents fd 1 (must return -1, actually -1)
+(getdents-bad-fd) getdents fd 5 (must return -1, actually -1)
+(getdents-bad-fd) getdents fd 537989684 (must return -1, actually -1)
+(getdents-bad-fd) end
+getdents-bad-fd: exit(0)
+EOF
+(getdents-bad-fd) begin
+getdents-bad-fd: exit(-1)
+EOF
+pass;
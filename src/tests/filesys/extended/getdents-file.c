@@ -0,0 +1,21 @@
+/* Opens an ordinary file, then tries to list it with getdents(),
+   which must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct dirent ent;
+  int fd;
+  int retval;
+
+  CHECK (create ("xyzzy", 512), "create \"xyzzy\"");
+  CHECK ((fd = open ("xyzzy")) > 1, "open \"xyzzy\"");
+
+  retval = getdents (fd, &ent, 1);
+  CHECK (retval == -1,
+         "getdents \"xyzzy\" (must return -1, actually %d)", retval);
+}
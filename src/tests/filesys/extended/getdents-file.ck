@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents-file) begin
+(getdents-file) create "xyzzy"
+(getdents-file) open "xyzzy"
+(getdents-file) getdents "xyzzy" (must return -1, actually -1)
+(getdents-file) end
+getdents-file: exit(0)
+EOF
+pass;
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{"a"}{"f$_"} = [''] foreach 0...9;
+$fs->{"a"}{"b"} = {};
+check_archive ($fs);
+pass;
@@ -0,0 +1,67 @@
+/* Lists a directory with more entries than one getdents() call
+   returns, and checks that each file shows up exactly once and
+   that "." and ".." are skipped. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10
+#define BATCH_CNT 3
+
+void
+test_main (void) 
+{
+  struct dirent ents[BATCH_CNT];
+  bool seen[FILE_CNT];
+  int total = 0;
+  int fd, cnt, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      char file_name[16];
+      snprintf (file_name, sizeof file_name, "a/f%d", i);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      seen[i] = false;
+    }
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  msg ("getdents \"a\", %d entries at a time", BATCH_CNT);
+  while ((cnt = getdents (fd, ents, BATCH_CNT)) > 0) 
+    {
+      if (cnt > BATCH_CNT)
+        fail ("getdents returned %d entries, asked for %d", cnt, BATCH_CNT);
+      if (total == 0 && cnt != BATCH_CNT)
+        fail ("first getdents returned %d entries, expected %d",
+              cnt, BATCH_CNT);
+      for (i = 0; i < cnt; i++) 
+        {
+          int n;
+          if (!strcmp (ents[i].name, ".") || !strcmp (ents[i].name, ".."))
+            fail ("getdents returned \"%s\"", ents[i].name);
+          if (ents[i].name[0] != 'f' || (n = atoi (ents[i].name + 1)) < 0
+              || n >= FILE_CNT)
+            fail ("getdents returned unexpected name \"%s\"", ents[i].name);
+          if (seen[n])
+            fail ("getdents returned \"%s\" twice", ents[i].name);
+          if (ents[i].is_dir)
+            fail ("getdents says file \"%s\" is a directory", ents[i].name);
+          seen[n] = true;
+          total++;
+        }
+    }
+  CHECK (cnt == 0, "getdents at end of \"a\" (must return 0, actually %d)",
+         cnt);
+  CHECK (total == FILE_CNT, "listed %d files (must be %d)", total, FILE_CNT);
+  close (fd);
+
+  CHECK (mkdir ("a/b"), "mkdir \"a/b\"");
+  CHECK ((fd = open ("a/b")) > 1, "open \"a/b\"");
+  cnt = getdents (fd, ents, BATCH_CNT);
+  CHECK (cnt == 0, "getdents \"a/b\" (must return 0, actually %d)", cnt);
+  close (fd);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents-many) begin
+(getdents-many) mkdir "a"
+(getdents-many) create "a/f0"
+(getdents-many) create "a/f1"
+(getdents-many) create "a/f2"
+(getdents-many) create "a/f3"
+(getdents-many) create "a/f4"
+(getdents-many) create "a/f5"
+(getdents-many) create "a/f6"
+(getdents-many) create "a/f7"
+(getdents-many) create "a/f8"
+(getdents-many) create "a/f9"
+(getdents-many) open "a"
+(getdents-many) getdents "a", 3 entries at a time
+(getdents-many) getdents at end of "a" (must return 0, actually 0)
+(getdents-many) listed 10 files (must be 10)
+(getdents-many) mkdir "a/b"
+(getdents-many) open "a/b"
+(getdents-many) getdents "a/b" (must return 0, actually 0)
+(getdents-many) end
+getdents-many: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Writes a file through a memory mapping, calls msync() on it
+   and halts with the mapping still in place.  Halting writes the
+   buffer cache to disk but not mapped pages, so the persistence
+   check only finds the data if msync() wrote it to the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define COPIES 300
+
+void
+test_main (void) 
+{
+  static const char pattern[] = "abcdefghij";
+  char *actual = (char *) 0x10000000;
+  size_t len = strlen (pattern);
+  int fd, i;
+  mapid_t map;
+
+  CHECK (create ("mapped", len * COPIES), "create \"mapped\"");
+  CHECK ((fd = open ("mapped")) > 1, "open \"mapped\"");
+  CHECK ((map = mmap (fd, actual)) != MAP_FAILED, "mmap \"mapped\"");
+  msg ("write \"mapped\" through the mapping");
+  for (i = 0; i < COPIES; i++)
+    memcpy (actual + i * len, pattern, len);
+  CHECK (msync (map, MS_SYNC) == 0, "msync \"mapped\"");
+
+  msg ("halt");
+  halt ();
+  fail ("should have halted");
+}
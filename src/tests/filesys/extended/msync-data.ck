@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(msync-data) begin
+(msync-data) create "mapped"
+(msync-data) open "mapped"
+(msync-data) mmap "mapped"
+(msync-data) write "mapped" through the mapping
+(msync-data) msync "mapped"
+(msync-data) halt
+EOF
+pass;
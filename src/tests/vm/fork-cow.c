@@ -0,0 +1,54 @@
+/* Forks a child that writes to a data page and a stack page it
+   shares with its parent, while the parent writes to them too.
+   Each process must see only its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+/* Returns true if all of the SIZE bytes in BLOCK are C. */
+static bool
+all_bytes (const char *block, char c, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (block[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  char stack[128];
+  pid_t child;
+
+  memset (buf, 'a', sizeof buf);
+  memset (stack, 'a', sizeof stack);
+  child = fork ();
+  if (child == 0)
+    {
+      /* The child reports through its exit code, so that its
+         output does not interleave with the parent's. */
+      if (!all_bytes (buf, 'a', sizeof buf)
+          || !all_bytes (stack, 'a', sizeof stack))
+        exit (1);
+      memset (buf, 'c', sizeof buf);
+      memset (stack, 'c', sizeof stack);
+      if (!all_bytes (buf, 'c', sizeof buf)
+          || !all_bytes (stack, 'c', sizeof stack))
+        exit (2);
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+
+  memset (buf, 'p', sizeof buf);
+  memset (stack, 'p', sizeof stack);
+  CHECK (wait (child) == 81, "wait for child (should return 81)");
+  CHECK (all_bytes (buf, 'p', sizeof buf), "check data page");
+  CHECK (all_bytes (stack, 'p', sizeof stack), "check stack page");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) fork
+(fork-cow) wait for child (should return 81)
+(fork-cow) check data page
+(fork-cow) check stack page
+(fork-cow) end
+EOF
+pass;
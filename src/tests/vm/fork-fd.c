@@ -0,0 +1,39 @@
+/* Forks a child that reads from a file its parent opened.  The
+   child must start at the parent's position, and its reads must
+   not move the parent's position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf[16];
+  int handle;
+  pid_t child;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf, sizeof buf) == (int) sizeof buf,
+         "read \"sample.txt\"");
+  child = fork ();
+  if (child == 0)
+    {
+      if (read (handle, buf, sizeof buf) != (int) sizeof buf
+          || memcmp (buf, sample + sizeof buf, sizeof buf))
+        exit (1);
+      close (handle);
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 81, "wait for child (should return 81)");
+
+  CHECK (tell (handle) == sizeof buf, "tell \"sample.txt\"");
+  CHECK (read (handle, buf, sizeof buf) == (int) sizeof buf,
+         "read \"sample.txt\" again");
+  if (memcmp (buf, sample + sizeof buf, sizeof buf))
+    fail ("read of \"sample.txt\" reported bad data");
+  close (handle);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-fd) begin
+(fork-fd) open "sample.txt"
+(fork-fd) read "sample.txt"
+(fork-fd) fork
+(fork-fd) wait for child (should return 81)
+(fork-fd) tell "sample.txt"
+(fork-fd) read "sample.txt" again
+(fork-fd) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Forks a child that reads a mapping its parent made, writes to
+   it and unmaps it.  The parent's mapping must survive, and the
+   child's write must reach the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char overwrite[] = "forked";
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  size_t size = strlen (sample);
+  int handle;
+  mapid_t map;
+  pid_t child;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  if (memcmp (actual, sample, size))
+    fail ("read of mmap'd file reported bad data");
+
+  child = fork ();
+  if (child == 0)
+    {
+      if (memcmp (actual, sample, size))
+        exit (1);
+      memcpy (actual, overwrite, strlen (overwrite));
+      munmap (map);
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 81, "wait for child (should return 81)");
+
+  /* The part of the page the child left alone is unchanged. */
+  CHECK (!memcmp (actual + strlen (overwrite), sample + strlen (overwrite),
+                  size - strlen (overwrite)),
+         "check mapping after child exits");
+  munmap (map);
+  close (handle);
+
+  memcpy (sample, overwrite, strlen (overwrite));
+  check_file ("sample.txt", sample, size);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-mmap) begin
+(fork-mmap) open "sample.txt"
+(fork-mmap) mmap "sample.txt"
+(fork-mmap) fork
+(fork-mmap) wait for child (should return 81)
+(fork-mmap) check mapping after child exits
+(fork-mmap) open "sample.txt" for verification
+(fork-mmap) verified contents of "sample.txt"
+(fork-mmap) close "sample.txt"
+(fork-mmap) end
+EOF
+pass;
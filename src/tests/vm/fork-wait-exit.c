@@ -0,0 +1,19 @@
+/* Forks a child that exits with a status of its own.  The parent
+   must get that status from wait, but only once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  child = fork ();
+  if (child == 0)
+    exit (42);
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 42, "wait for child (should return 42)");
+  CHECK (wait (child) == -1, "wait for child again (should return -1)");
+}
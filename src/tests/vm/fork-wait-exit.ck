@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-wait-exit) begin
+(fork-wait-exit) fork
+(fork-wait-exit) wait for child (should return 42)
+(fork-wait-exit) wait for child again (should return -1)
+(fork-wait-exit) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Writes to a memory mapping, syncs it with msync, and reads the
+   file back with read() while the mapping is still in place.
+   read() may be served from the mapped page itself, so this
+   checks msync's flag handling and return values; msync-data in
+   tests/filesys/extended checks that the data reaches the disk. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  static const char overwrite[] = "Now is the time for all good...";
+  static char buffer[sizeof sample - 1];
+  char *actual = (char *) 0x54321000;
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (actual, overwrite, strlen (overwrite));
+
+  CHECK (msync (map, MS_SYNC | MS_ASYNC) == -1,
+         "msync with MS_SYNC | MS_ASYNC (must return -1)");
+  CHECK (msync (map, 0x100) == -1,
+         "msync with unknown flags (must return -1)");
+  CHECK (msync (map + 1, MS_SYNC) == -1,
+         "msync of bad mapping (must return -1)");
+  CHECK (msync (map, MS_SYNC) == 0, "msync \"sample.txt\"");
+
+  /* Read the file back through the file system. */
+  memcpy (sample, overwrite, strlen (overwrite));
+  seek (handle, 0);
+  CHECK (read (handle, buffer, sizeof buffer) == sizeof buffer,
+         "read \"sample.txt\"");
+  if (memcmp (buffer, sample, sizeof buffer))
+    fail ("read of msync'd file reported bad data");
+
+  munmap (map);
+  close (handle);
+}
@@ -38,6 +38,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -131,6 +132,7 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  ramdisk_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -255,6 +257,20 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          if (!ramdisk_add (value))
+            PANIC ("bad or too many ramdisks `%s'", value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-ramdisk-latency"))
+        ramdisk_set_latency (value != NULL ? atoi (value) : 0);
+      else if (!strcmp (name, "-iotrace"))
+        block_enable_trace ();
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !block_set_default_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s'", value != NULL ? value : "");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -381,6 +397,13 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=SIZE      Add a SIZE kB (or SIZE`M' MB) RAM disk,\n"
+          "                     named ram0, ram1, ... in order.\n"
+          "  -ramdisk-latency=US  Delay each RAM disk access by US us.\n"
+          "  -iotrace           Print the last block device accesses at\n"
+          "                     shutdown.\n"
+          "  -iosched=NAME      Schedule disk I/O with deadline (default),\n"
+          "                     noop or none.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -407,10 +430,28 @@ locate_block_devices (void)
 #endif
 }
 
+/* Returns true if BLOCK shares a hardware channel with a block
+   device already cast in a role. */
+static bool
+channel_in_use (struct block *block)
+{
+  enum block_type role;
+
+  for (role = 0; role < BLOCK_ROLE_CNT; role++)
+    {
+      struct block *other = block_get_role (role);
+      if (other != NULL && block_same_channel (block, other))
+        return true;
+    }
+  return false;
+}
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
-   otherwise the first block device in probe order of type
-   ROLE. */
+   otherwise the first block device in probe order of type ROLE
+   that is on a channel no other role uses, so that the roles
+   can do I/O in parallel, or failing that the first block
+   device of type ROLE. */
 static void
 locate_block_device (enum block_type role, const char *name)
 {
@@ -424,14 +465,27 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
+      struct block *first = NULL;
+
       for (block = block_first (); block != NULL; block = block_next (block))
         if (block_type (block) == role)
-          break;
+          {
+            if (first == NULL)
+              first = block;
+            if (!channel_in_use (block))
+              break;
+          }
+      if (block == NULL)
+        block = first;
     }
 
   if (block != NULL)
     {
-      printf ("%s: using %s\n", block_type_name (role), block_name (block));
+      if (*block_channel (block) != '\0')
+        printf ("%s: using %s on %s\n", block_type_name (role),
+                block_name (block), block_channel (block));
+      else
+        printf ("%s: using %s\n", block_type_name (role), block_name (block));
       block_set_role (role, block);
     }
 }
@@ -132,6 +132,9 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+#ifdef VM
+  t->vtime++;
+#endif
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
@@ -226,7 +229,11 @@ thread_create (const char *name, int priority,
 
   t->map_files = 0;
   list_init(&t->mmap_list);
+  list_init(&t->vma_list);
   t->saved_esp = NULL;
+  t->swap_ra_window = 0;
+  t->vtime = 0;
+  t->last_swap_fault = NULL;
 #endif
   
   /* Stack frame for kernel_thread(). */
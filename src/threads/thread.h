@@ -111,11 +111,16 @@ struct thread
     struct hash spt_table; /* Supplemental page table for this thread. */
     int map_files;  /* Mmap id. */
     struct list mmap_list; /* All mmap units. */
+    struct list vma_list; /* Executable and mmap areas, see vm/vma.c. */
     /* If the page fault occurs in the kernel, must save the esp. */
     void* saved_esp; 
+    int swap_ra_window; /* Pages to read ahead on a swap fault. */
+    int64_t vtime; /* Ticks this thread has run, its virtual time. */
+    uint8_t *last_swap_fault; /* Page of the last swap fault. */
 #endif
 
     struct dir *working_dir; 
+    int journal_depth;  /* Nesting depth of journal handles. */
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
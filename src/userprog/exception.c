@@ -156,7 +156,7 @@ page_fault (struct intr_frame *f)
   if(not_present && fault_addr > LOW_USER_BASE && is_user_vaddr(fault_addr))
   { 
     /* First check if we need to load a page from file or swap. */
-    loaded = spt_load_page (pg_round_down(fault_addr));
+    loaded = spt_fault_page (pg_round_down (fault_addr), write);
     if (!loaded)
     { 
       /* Need grow stack? */
@@ -166,10 +166,16 @@ page_fault (struct intr_frame *f)
           && (fault_addr == sp - 32 || fault_addr == sp - 4 || fault_addr >= sp))
       { 
         if(spt_add (VM_STACK_TYPE, fault_addr, true))
-          loaded = spt_load_page(pg_round_down(fault_addr));
+          loaded = spt_fault_page (pg_round_down (fault_addr), write);
       }
     }
   }
+  else if (!not_present && write && fault_addr > LOW_USER_BASE 
+    && is_user_vaddr (fault_addr))
+  {
+    /* Writing a copy-on-write page shared since fork. */
+    loaded = spt_write_page (pg_round_down (fault_addr));
+  }
 
   /* Fail to load page. */
   /* If user access, kill the user program. */
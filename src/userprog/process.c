@@ -23,8 +23,10 @@
 #include "threads/synch.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/vma.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (struct exec_msg *msg, void (**eip) (void), void **esp);
 
 #define INITIAL_STATUS -2
@@ -123,6 +125,137 @@ start_process (void *aux)
   NOT_REACHED ();
 }
 
+/* Starts a copy of the current process, which returns from the
+   system call in F with 0 while the current process gets the new
+   process's thread id, or TID_ERROR if it cannot be created.
+   Their memory is shared copy-on-write, see vm/pagecache.c. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct fork_msg msg;
+  tid_t tid;
+
+  msg.parent = thread_current ();
+  msg.if_ = *f;
+  sema_init (&msg.done_sema, 0);
+  msg.success = false;
+
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, &msg);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&msg.done_sema); /* wait for the new process to copy us */
+  return msg.success ? tid : TID_ERROR;
+}
+
+/* Copy the open files of parent into the current process, with
+   the same descriptors and positions. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->file_list);
+       e != list_end (&parent->file_list); e = list_next (e))
+  {
+    struct process_file *ppf = list_entry (e, struct process_file, elem);
+    struct process_file *pf = malloc (sizeof (struct process_file));
+    if (pf == NULL)
+      return false;
+    pf->fd = ppf->fd;
+    pf->file = NULL;
+    pf->dir = NULL;
+    list_push_back (&t->file_list, &pf->elem);
+    if (ppf->file != NULL)
+    {
+      pf->file = file_reopen (ppf->file);
+      if (pf->file == NULL)
+        return false;
+      file_seek (pf->file, file_tell (ppf->file));
+    }
+    else
+    {
+      pf->dir = dir_reopen (ppf->dir);
+      if (pf->dir == NULL)
+        return false;
+    }
+  }
+  t->fd = parent->fd;
+  return true;
+}
+
+/* Copy the mmaps of parent into the current process. */
+static bool
+fork_mmaps (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->mmap_list);
+       e != list_end (&parent->mmap_list); e = list_next (e))
+  {
+    struct mmap_file *pmmap = list_entry (e, struct mmap_file, elem);
+    struct mmap_file *mmap = malloc (sizeof (struct mmap_file));
+    if (mmap == NULL)
+      return false;
+    mmap->file = file_reopen (pmmap->file);
+    if (mmap->file == NULL)
+    {
+      free (mmap);
+      return false;
+    }
+    mmap->mapid = pmmap->mapid;
+    mmap->addr = pmmap->addr;
+    mmap->page_cnt = pmmap->page_cnt;
+    list_push_back (&t->mmap_list, &mmap->elem);
+  }
+  t->map_files = parent->map_files;
+  return true;
+}
+
+/* A thread function that copies the process that forked it and
+   starts it running. */
+static void
+start_fork (void *aux)
+{
+  struct fork_msg *msg = (struct fork_msg *) aux;
+  struct thread *parent = msg->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = msg->if_;
+  bool success = false;
+
+  if (parent->working_dir == NULL)
+    t->working_dir = dir_open_root ();
+  else
+    t->working_dir = dir_reopen (parent->working_dir);
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+  process_activate ();
+
+  t->exec_file = file_reopen (parent->exec_file);
+  if (t->exec_file == NULL)
+    goto done;
+  file_deny_write (t->exec_file);
+
+  if (!fork_files (parent) || !fork_mmaps (parent))
+    goto done;
+  if (!spt_fork (parent))
+    goto done;
+  success = true;
+
+ done:
+  msg->success = success;
+  sema_up (&msg->done_sema);
+  if (!success)
+    exit (EXIT_ERROR);
+
+  /* The child returns 0 from fork. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
 
 /* checks if child_tid is one of current thread's children */
 static bool
@@ -515,6 +648,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   The segment becomes one area of the process, whose pages are
+   set up as they are touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -525,25 +661,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      if (!spt_add (VM_EXECUTABLE_TYPE, upage, writable, file, ofs, page_read_bytes))
-        return false;
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += page_read_bytes;
-    }
-  return true;
+  return vma_add (VM_EXECUTABLE_TYPE, upage, (read_bytes + zero_bytes) / PGSIZE,
+                  writable, file, ofs, read_bytes);
 }
 
 /* decrease stack pointer and copy data to new stack pointer */
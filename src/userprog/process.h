@@ -3,6 +3,7 @@
 
 #include "threads/thread.h"
 #include "threads/synch.h"
+#include "threads/interrupt.h"
 typedef int tid_t;
 
 /* struct used for keeping track of process information
@@ -36,7 +37,17 @@ struct exec_msg
   struct dir *working_dir;
 };
 
+/* Message passed to a process created by fork. */
+struct fork_msg
+{
+  struct thread *parent;
+  struct intr_frame if_;  /* Parent's user context at the syscall. */
+  struct semaphore done_sema; /* semaphore to indicate that the copy is done */
+  bool success;
+};
+
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *f);
 int process_wait (tid_t child_tid);
 void process_exit (void);
 void process_activate (void);
@@ -2,6 +2,7 @@
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include <stdio.h>
+#include <round.h>
 #include <stdint.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
@@ -15,8 +16,11 @@
 #include "threads/synch.h"
 #include "filesys/directory.h"
 #include "filesys/inode.h"
+#include "filesys/cache.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/pagecache.h"
+#include "vm/vma.h"
 
 #define STACK_MAX ((void *) (1 << 23)) /* Max stack is 8MB. */
 #define LOW_USER_BASE ((void *) 0x08048000)
@@ -162,6 +166,11 @@ syscall_handler (struct intr_frame *f)
 	    f->eax = (uint32_t) exec (file); 
       break;
     }
+    case SYS_FORK:
+    {
+      f->eax = (uint32_t) sys_fork (f);
+      break;
+    }
     case SYS_WAIT:
     {
       pid_t id = * (pid_t *) get_arg (sp, 1);
@@ -246,6 +255,13 @@ syscall_handler (struct intr_frame *f)
       munmap(id);
       break;
     }
+    case SYS_MSYNC:
+    {
+      mapid_t id = * (mapid_t *) get_arg (sp, 1);
+      int flags = * (int *) get_arg (sp, 2);
+      f->eax = msync (id, flags);
+      break;
+    }
     case SYS_CHDIR:
     {
       const char *dir = * (const char **) get_arg (sp, 1);
@@ -280,6 +296,28 @@ syscall_handler (struct intr_frame *f)
       f->eax = inumber(fd);
       break;
     }
+    case SYS_GETDENTS:
+    {
+      int fd = * (int *) get_arg (sp, 1);
+      struct dirent *ents = * (struct dirent **) get_arg (sp, 2);
+      unsigned cnt = * (unsigned *) get_arg (sp, 3);
+      if (cnt > (size_t) PHYS_BASE / sizeof *ents)
+        exit (EXIT_ERROR);
+      check_user_write ((uint8_t *) ents, (size_t) cnt * sizeof *ents);
+      f->eax = getdents (fd, ents, cnt);
+      break;
+    }
+    case SYS_FSYNC:
+    {
+      int fd = * (int *) get_arg (sp, 1);
+      f->eax = fsync (fd);
+      break;
+    }
+    case SYS_SYNC:
+    {
+      sync ();
+      break;
+    }
   }
 }
 
@@ -304,6 +342,14 @@ exec (const char *file)
   return (id == TID_ERROR) ? PID_ERROR : id;
 }
 
+/* The child returns 0, see process_fork. */
+pid_t
+sys_fork (struct intr_frame *f)
+{
+  tid_t id = process_fork (f);
+  return (id == TID_ERROR) ? PID_ERROR : id;
+}
+
 int 
 wait (pid_t pid)
 { 
@@ -554,43 +600,23 @@ mapid_t mmap (int fd, void *addr)
     return -1;
   }
 
+  /* The whole mapping is one area, its pages are read as they
+     are touched. It must stay below the stack. */
   mmap->addr = addr;
-  mmap->page_cnt = 0;
+  mmap->page_cnt = DIV_ROUND_UP (read_bytes, PGSIZE);
+  if ((size_t) ((uint8_t *) (PHYS_BASE - STACK_MAX) - (uint8_t *) addr)
+      / PGSIZE < mmap->page_cnt
+      || !vma_add (VM_MMAP_TYPE, addr, mmap->page_cnt, true, mmap->file, 0,
+                   read_bytes))
+  {
+    file_close (mmap->file);
+    free (mmap);
+    return -1;
+  }
 
   t->map_files++;
   mmap->mapid = t->map_files;
   list_push_back (&t->mmap_list, &mmap->elem);
-  
-  int32_t ofs = 0;
-  while (read_bytes > 0) 
-  {
-    /* Calculate how to fill this page.
-    We will read PAGE_READ_BYTES bytes from FILE
-    and zero the final PAGE_ZERO_BYTES bytes. */
-    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-
-    if (spt_add (VM_MMAP_TYPE, addr, true, mmap->file, ofs, page_read_bytes))
-    {
-      /* Successfully allocate a supplemental page table entry. */
-      struct spt_entry *spe = spt_get (addr);
-      ASSERT (spe != NULL);
-      mmap->page_cnt++;
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      addr += PGSIZE;
-      ofs += page_read_bytes;
-    }
-    else
-    { 
-      /* Fail to allocate a supplemental page table entry. */
-      /* Must clear all the mmap_file and supplemental page table 
-         entry related to this file allocated previously. */ 
-      munmap (mmap->mapid);
-      return -1;
-    }
-  }
-  
   return mmap->mapid;
 }
 
@@ -609,12 +635,22 @@ void munmap (mapid_t mapping)
     if (mmap->mapid == mapping)
     {
       list_remove (&mmap->elem);
-      while (mmap->page_cnt-- > 0)
+
+      /* Only the touched pages of the area have an entry. A
+         forked process that failed to copy its areas may have
+         none. */
+      struct vma *vma = vma_find (mmap->addr);
+      while (vma != NULL && !list_empty (&vma->pages))
       {
-        struct spt_entry *spe = spt_get (mmap->addr);
-        ASSERT (spe != NULL);
-        /* Must acquire frame lock first to avoid race. */
-        spt_lock_frame (spe);
+        struct spt_entry *spe = list_entry (list_pop_front (&vma->pages),
+          struct spt_entry, vma_elem);
+        /* Shared pages are written back with their last mapping,
+           which leaves spe without a frame. Otherwise must acquire
+           frame lock first to avoid race. */
+        if (spe->cpage != NULL)
+          pagecache_unmap (spe);
+        else
+          spt_lock_frame (spe);
         if (spe->fte != NULL)
         {
           pagedir_clear_page (t->pagedir, spe->u_addr);
@@ -627,8 +663,9 @@ void munmap (mapid_t mapping)
         }
         hash_delete (&t->spt_table, &spe->elem);
         free (spe);
-        mmap->addr += PGSIZE;
       }
+      if (vma != NULL)
+        vma_remove (vma);
       file_close (mmap->file);
       free (mmap);
       return;
@@ -639,6 +676,63 @@ void munmap (mapid_t mapping)
   return;
 }
 
+/* Msync system call. */
+/* Writes the modified pages of the mapping back to its file.
+   With MS_ASYNC, pages shared through the page cache are left to
+   its flusher. Returns 0 if successful, -1 if there is no such
+   mapping or flags has unknown bits or both MS_SYNC and MS_ASYNC. */
+int msync (mapid_t mapping, int flags)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+  struct mmap_file *mmap;
+  struct vma *vma;
+  struct list_elem *pe;
+
+  if ((flags & ~(MS_ASYNC | MS_SYNC)) != 0
+      || (flags & (MS_ASYNC | MS_SYNC)) == (MS_ASYNC | MS_SYNC))
+    return -1;
+
+  for (e = list_begin (&t->mmap_list); e != list_end (&t->mmap_list);
+       e = list_next (e))
+  {
+    mmap = list_entry (e, struct mmap_file, elem);
+    if (mmap->mapid != mapping)
+      continue;
+
+    /* Pages never touched can't be modified. */
+    vma = vma_find (mmap->addr);
+    ASSERT (vma != NULL);
+    for (pe = list_begin (&vma->pages); pe != list_end (&vma->pages);
+         pe = list_next (pe))
+    {
+      struct spt_entry *spe = list_entry (pe, struct spt_entry, vma_elem);
+      if (spe->cpage != NULL)
+      {
+        if (!(flags & MS_ASYNC))
+          pagecache_clean (spe);
+        continue;
+      }
+
+      /* A private page, clear the dirty bit before writing so
+         that stores made meanwhile set it again. */
+      spt_lock_frame (spe);
+      if (spe->fte != NULL)
+      {
+        if (pagedir_is_dirty (t->pagedir, spe->u_addr))
+        {
+          pagedir_set_dirty (t->pagedir, spe->u_addr, false);
+          file_write_at (spe->file, spe->fte->k_addr, spe->file_bytes, 
+            spe->ofs);
+        }
+        lock_release (&spe->fte->l);
+      }
+    }
+    return 0;
+  }
+  return -1;
+}
+
 /* Unmap all the mmap the process holds. */
 /* Called when process exits. */
 void close_all_mmap(void)
@@ -699,3 +793,36 @@ int inumber (int fd)
     return -1;
   return inode_get_inumber(inode);
 }
+
+/* Fills ENTS with up to CNT entries of directory FD.
+   Returns the number of entries read, 0 at the end of the
+   directory, or -1 if FD is not an open directory. */
+int getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  struct process_file *pf = get_process_file (fd);
+  if (pf == NULL || pf->dir == NULL)
+    return -1;
+  return dir_getdents (pf->dir, ents, cnt);
+}
+
+/* Writes the modified data of file or directory FD to disk.
+   Returns false if FD is not open. */
+bool fsync (int fd)
+{
+  struct process_file *pf = get_process_file (fd);
+  struct inode *inode;
+  if (pf == NULL)
+    return false;
+  if (pf->dir != NULL)
+    inode = dir_get_inode (pf->dir);
+  else
+    inode = file_get_inode (pf->file);
+  inode_flush (inode);
+  return true;
+}
+
+/* Writes all modified file system data to disk. */
+void sync (void)
+{
+  cache_flush ();
+}
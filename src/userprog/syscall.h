@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <list.h>
+#include <dirent.h>
+
+struct intr_frame;
 
 /* Process identifier. */
 typedef int pid_t;
@@ -26,6 +29,7 @@ void syscall_init (void);
 void halt (void);
 void exit (int status);
 pid_t exec (const char *file);
+pid_t sys_fork (struct intr_frame *f);
 int wait (pid_t);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
@@ -39,11 +43,15 @@ void close (int fd);
 void close_all (void);
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t mapping);
+int msync (mapid_t mapping, int flags);
 void close_all_mmap(void);
 bool chdir (const char *dir);
 bool mkdir (const char *dir);
 bool readdir (int fd, char *name);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *ents, unsigned cnt);
+bool fsync (int fd);
+void sync (void);
 
 #endif /* userprog/syscall.h */
@@ -1,4 +1,6 @@
+#include <stdio.h>
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
@@ -9,6 +11,7 @@
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/pagecache.h"
 
 /* The frame table. */
 struct frame_table_entry* frame_table;
@@ -21,6 +24,48 @@ struct lock frame_table_lock;
 /* Hand for clock algorithm .*/
 int hand; 
 
+/* Frames not holding any page, most recently freed first. */
+/* A frame is owned by whoever removes it from this list. */
+struct list free_frames;
+size_t free_frame_cnt;
+
+/* Protects free_frames, free_frame_cnt and the free member of
+   each frame. Never held while acquiring another lock. */
+struct lock free_frames_lock;
+
+/* Free frame watermarks. Below frames_low the page-out daemon,
+   waiting on pageout_wanted, starts evicting pages. It stops
+   when frames_high frames are free. */
+size_t frames_low;
+size_t frames_high;
+struct condition pageout_wanted;
+
+static void pageout_daemon (void *aux);
+
+/* Working set window. A page belongs to its process's working
+   set if the process used it within its last WS_TAU ticks of
+   running time. */
+#define WS_TAU (TIMER_FREQ / 4)
+
+/* Kinds of evictions, for statistics. */
+enum evict_kind
+  {
+    EVICT_STACK,                /* Stack page, written to swap. */
+    EVICT_EXEC_CLEAN,           /* Unmodified executable page, dropped. */
+    EVICT_EXEC_DIRTY,           /* Modified executable page, to swap. */
+    EVICT_MMAP_CLEAN,           /* Unmodified mmap page, dropped. */
+    EVICT_MMAP_DIRTY,           /* Modified mmap page, written back. */
+    EVICT_READAHEAD,            /* Unused swap readahead, dropped. */
+    EVICT_KIND_CNT
+  };
+
+/* Number of evictions of each kind. */
+static unsigned long long evict_cnt[EVICT_KIND_CNT];
+
+/* How many frames after the clock hand to look at for pages
+   to swap out along with an evicted page. */
+#define CLUSTER_SCAN (2 * SWAP_CLUSTER)
+
 /* Init frame table .*/
 void
 frame_table_init (void)
@@ -30,6 +75,9 @@ frame_table_init (void)
     PANIC ("Can't init frame table");
 
   frame_cnt = 0;
+  list_init (&free_frames);
+  free_frame_cnt = 0;
+  lock_init (&free_frames_lock);
   uint8_t* k_addr;
   struct frame_table_entry *fte;
   while ((k_addr = palloc_get_page (PAL_USER)))
@@ -38,142 +86,504 @@ frame_table_init (void)
     lock_init (&fte->l);
     fte->k_addr = k_addr;
     fte->spe = NULL;
+    fte->cpage = NULL;
+    list_push_back (&free_frames, &fte->free_elem);
+    fte->free = true;
+    free_frame_cnt++;
   }
 	lock_init (&frame_table_lock);
   hand = -1;
+
+  frames_low = frame_cnt / 32;
+  if (frames_low < SWAP_CLUSTER)
+    frames_low = SWAP_CLUSTER;
+  frames_high = 2 * frames_low;
+  cond_init (&pageout_wanted);
+  pagecache_init ();
+  spt_zero_page_init ();
+  thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
 }
 
-/* Try to allocate a frame for page. */
-/* Immediately lock it after allocation. */
-/* If no frame avaliable, try to evict one .*/
-/* Return NULL on failure. */
-struct frame_table_entry *
-frame_alloc_and_lock (struct spt_entry *spe)
+/* Put fte, whose lock we hold, on the free frame list. */
+static void
+free_frame (struct frame_table_entry *fte)
 {
-	/* At most try 3 times .*/
-  int try_num;
-  for (try_num = 0 ; try_num < 3 ; try_num++)
+  ASSERT (lock_held_by_current_thread (&fte->l));
+  fte->spe = NULL;
+  lock_acquire (&free_frames_lock);
+  list_push_front (&free_frames, &fte->free_elem);
+  fte->free = true;
+  free_frame_cnt++;
+  lock_release (&free_frames_lock);
+}
+
+/* Take fte, whose lock we hold and which has no page, off the
+   free frame list. */
+/* Return false if another thread took it first. */
+static bool
+claim_frame (struct frame_table_entry *fte)
+{
+  bool claimed;
+  lock_acquire (&free_frames_lock);
+  claimed = fte->free;
+  if (claimed)
   {
-    /* First try to get free frame. */
-    int i;
-    struct frame_table_entry *fte;
-    /* First try to get free frame. */
-    for (i = 0; i < frame_cnt; i++)
+    list_remove (&fte->free_elem);
+    fte->free = false;
+    free_frame_cnt--;
+  }
+  lock_release (&free_frames_lock);
+  return claimed;
+}
+
+/* Count an eviction of the given kind. */
+static void
+count_eviction (enum evict_kind kind)
+{
+  enum intr_level old_level = intr_disable ();
+  evict_cnt[kind]++;
+  intr_set_level (old_level);
+}
+
+/* Return true if the page in fte, whose lock we hold, was used
+   within its owner's working set window. */
+static bool
+in_working_set (struct frame_table_entry *fte)
+{
+  return fte->spe->t->vtime - fte->last_used <= WS_TAU;
+}
+
+/* Return true if evicting the page costs a write. */
+/* Only a hint until the page has been cleared from its page
+   table. */
+static bool
+needs_write (struct spt_entry *spe)
+{
+  return spe->file == NULL
+    || pagedir_is_dirty (spe->t->pagedir, spe->u_addr);
+}
+
+/* Return true if evicting the page means writing it to swap. */
+/* For executable pages this is only a hint until the page has
+   been cleared from its page table. */
+static bool
+goes_to_swap (struct spt_entry *spe)
+{
+  if (spe->prefetched)
+    return false;
+  return spe->file == NULL 
+    || (spe->type == VM_EXECUTABLE_TYPE
+        && pagedir_is_dirty (spe->t->pagedir, spe->u_addr));
+}
+
+/* Collect frames after the clock hand whose pages have not been
+   used recently and go to swap, so that they can be swapped out
+   in one cluster with the page being evicted. */
+/* Lock each collected frame and clear its page from the page
+   table, store it in cluster and return the number collected. */
+/* Must hold frame_table_lock. */
+static size_t
+gather_cluster (struct frame_table_entry **cluster)
+{
+  size_t cnt = 0;
+  int i;
+  for (i = 1 ; i <= CLUSTER_SCAN && i < frame_cnt 
+    && cnt < SWAP_CLUSTER - 1 ; i++)
+  {
+    struct frame_table_entry *fte = &frame_table[(hand + i) % frame_cnt];
+    if (!lock_try_acquire (&fte->l))
+      continue;
+
+    struct spt_entry *spe = fte->spe;
+    if (spe == NULL || spe->fte != fte || fte->cpage != NULL
+      || pagedir_is_accessed (spe->t->pagedir, spe->u_addr)
+      || in_working_set (fte)
+      || !goes_to_swap (spe))
     {
-      fte = &frame_table[i];
-      if (!lock_try_acquire (&fte->l))
-        continue;
-      if (fte->spe == NULL) 
-        {
-          fte->spe = spe;
-          return fte;
-        } 
       lock_release (&fte->l);
+      continue;
+    }
+    pagedir_clear_page (spe->t->pagedir, spe->u_addr);
+    cluster[cnt++] = fte;
+  }
+  return cnt;
+}
+
+/* Write the page in victim, if not NULL, and the pages in the
+   cnt frames of cluster to swap as one cluster. */
+/* Free the frames of cluster, or map their pages back in if
+   swap is full, and unlock them. */
+/* Return the sector victim's page went to, or 
+   (block_sector_t) -1. */
+static block_sector_t
+swap_out (struct frame_table_entry *victim, 
+  struct frame_table_entry **cluster, size_t cnt)
+{
+  uint8_t *addrs[SWAP_CLUSTER];
+  block_sector_t sectors[SWAP_CLUSTER];
+  size_t n = 0;
+  size_t i;
+
+  if (victim != NULL)
+    addrs[n++] = victim->k_addr;
+  for (i = 0 ; i < cnt ; i++)
+    addrs[n++] = cluster[i]->k_addr;
+  if (n == 0)
+    return (block_sector_t) -1;
+  swap_alloc_cluster (addrs, sectors, n);
+
+  for (i = 0 ; i < cnt ; i++)
+  {
+    struct frame_table_entry *fte = cluster[i];
+    struct spt_entry *spe = fte->spe;
+    block_sector_t sector_id = sectors[victim != NULL ? i + 1 : i];
+    if (sector_id != (block_sector_t) -1)
+    {
+      count_eviction (spe->type == VM_EXECUTABLE_TYPE 
+        ? EVICT_EXEC_DIRTY : EVICT_STACK);
+      /* Store the slot first, so that a reader that sees no frame
+         without holding its lock, such as spt_fork, sees the slot. */
+      spe->sector_id = sector_id;
+      barrier ();
+      spe->fte = NULL;
+      free_frame (fte);
+    }
+    else
+    {
+      /* Swap is full, keep the page in memory. */
+      bool dirty = pagedir_is_dirty (spe->t->pagedir, spe->u_addr);
+      pagedir_set_page (spe->t->pagedir, spe->u_addr, fte->k_addr, 
+        spe->writable);
+      if (dirty)
+        pagedir_set_dirty (spe->t->pagedir, spe->u_addr, true);
     }
+    lock_release (&fte->l);
+  }
+  return victim != NULL ? sectors[0] : (block_sector_t) -1;
+}
+
+/* Try to allocate a free frame for page, without evicting. */
+/* Immediately lock it after allocation. */
+/* Return NULL if no frame is free. */
+struct frame_table_entry *
+frame_try_alloc_and_lock (struct spt_entry *spe)
+{
+  struct frame_table_entry *fte = NULL;
+
+  lock_acquire (&free_frames_lock);
+  if (!list_empty (&free_frames))
+  {
+    fte = list_entry (list_pop_front (&free_frames), 
+      struct frame_table_entry, free_elem);
+    fte->free = false;
+    free_frame_cnt--;
+  }
+  if (free_frame_cnt < frames_low)
+    cond_signal (&pageout_wanted, &free_frames_lock);
+  lock_release (&free_frames_lock);
+  if (fte == NULL)
+    return NULL;
+
+  /* A clock scan may hold the lock for a moment, but it won't
+     take the frame now that it is off the list. */
+  lock_acquire (&fte->l);
+  ASSERT (fte->spe == NULL);
+  fte->spe = spe;
+  fte->last_used = spe->t->vtime;
+  return fte;
+}
+
+/* Evict a page and give its frame to page spe, which may be
+   NULL. */
+/* Uses WSClock: the hand passes over frames, marking pages that
+   have been accessed as used at their owner's current virtual
+   time. The first pass evicts only clean pages outside their
+   owner's working set, leaving dirty ones for the page-out
+   daemon to write back. The second pass also takes dirty pages
+   outside the working set, and the third any page not accessed
+   since the hand last passed. */
+/* Return the frame locked, or NULL if no page could be
+   evicted. */
+static struct frame_table_entry *
+clock_evict (struct spt_entry *spe)
+{
+  int i;
+  struct frame_table_entry *fte;
+  struct spt_entry *spe_tmp = NULL;
+  bool dirty_seen = false;
 
-    /* If we don't have free frame, try to evict. */
-    struct spt_entry *spe_tmp = NULL;
+  /* Acquire global lock first tp protect clock hand. */ 
+  lock_acquire (&frame_table_lock);
 
-    /* Acquire global lock first tp protect clock hand. */ 
-    lock_acquire (&frame_table_lock);
+  for (i = 0 ; i < 3 * frame_cnt ; i++) 
+  {
+    int pass = i / frame_cnt;
 
-    /* Each time we scan frame table table twice. */
-    for (i = 0 ; i < 2 * frame_cnt ; i++) 
+    /* No clean page to take, have the daemon clean some. */
+    if (i == frame_cnt && dirty_seen && spe != NULL)
     {
-      if(++hand == frame_cnt)
-        hand = 0;
+      lock_acquire (&free_frames_lock);
+      cond_signal (&pageout_wanted, &free_frames_lock);
+      lock_release (&free_frames_lock);
+    }
+
+    if(++hand == frame_cnt)
+      hand = 0;
 
-      /* Get a frame from the frame table. */
-      fte = &frame_table[hand];
+    /* Get a frame from the frame table. */
+    fte = &frame_table[hand];
 
-      /* Must lock the frame first to prevent race. */
-      /* If failed, other page is modifying it, we 
-        continue to find next frame. */
-      if (!lock_try_acquire (&fte->l))
+    /* Must lock the frame first to prevent race. */
+    /* If failed, other page is modifying it, we 
+      continue to find next frame. */
+    if (!lock_try_acquire (&fte->l))
+      continue;
+    
+    /* This frame may have been freed, double check. */ 
+    /* The page-out daemon leaves free frames alone. */
+    if (fte->spe == NULL) 
+    {
+      if (spe == NULL || !claim_frame (fte))
+      {
+        /* Being handed out from the free list, or not wanted. */
+        lock_release (&fte->l);
         continue;
+      }
+      fte->spe = spe;
+      fte->last_used = spe->t->vtime;
+      lock_release (&frame_table_lock);
+      return fte;
+    } 
       
-      /* This frame may have been freed, double check. */ 
-      if (fte->spe == NULL) 
-      {
-        fte->spe = spe;
-        lock_release (&frame_table_lock);
-        return fte;
-      } 
-        
-      spe_tmp = fte->spe;
+    spe_tmp = fte->spe;
+
+    /* A page read ahead from swap but never used still has its
+       swap slot, so drop it right away, and read ahead less. */
+    if (spe_tmp->prefetched)
+    {
+      spe_tmp->prefetched = false;
+      spe_tmp->fte = NULL;
+      spe_tmp->t->swap_ra_window /= 2;
+      count_eviction (EVICT_READAHEAD);
+      fte->spe = spe;
+      if (spe != NULL)
+        fte->last_used = spe->t->vtime;
+      lock_release (&frame_table_lock);
+      return fte;
+    }
 
-      /* Check accessed bit. */
-      if (pagedir_is_accessed (spe_tmp->t->pagedir, spe_tmp->u_addr))
+    /* A shared page is in use while any process mapping it uses
+       it, and dirty if any of them modified it. */
+    if (fte->cpage != NULL)
+    {
+      if (!pagecache_try_lock ())
       {
-        /* If it has been accessed recently, clear the access bit. */
-        pagedir_set_accessed (spe_tmp->t->pagedir, spe_tmp->u_addr, false);
         lock_release (&fte->l);
         continue;
       }
-            
-      /* Try to evict this frame. */
+      if (pagecache_accessed (fte))
+        fte->last_used = spe_tmp->t->vtime;
+      else if ((pass < 2 && in_working_set (fte))
+        || (pass == 0 && pagecache_dirty (fte)) || pagecache_writing (fte))
+      {
+        if (pass == 0 && !in_working_set (fte))
+          dirty_seen = true;
+      }
+      else
+      {
+        int type = spe_tmp->type;
+        struct cached_page *cp = pagecache_evict (fte);
+        pagecache_unlock ();
+        lock_release (&frame_table_lock);
+        if (cp == NULL)
+          count_eviction (type == VM_MMAP_TYPE 
+            ? EVICT_MMAP_CLEAN : EVICT_EXEC_CLEAN);
+        else if (pagecache_write_back (cp, fte))
+          count_eviction (type == VM_MMAP_TYPE ? EVICT_MMAP_DIRTY 
+            : type == VM_EXECUTABLE_TYPE ? EVICT_EXEC_DIRTY : EVICT_STACK);
+        else
+        {
+          /* Swap is full, try another one. */
+          lock_release (&fte->l);
+          lock_acquire (&frame_table_lock);
+          continue;
+        }
+        fte->spe = spe;
+        if (spe != NULL)
+          fte->last_used = spe->t->vtime;
+        return fte;
+      }
+      pagecache_unlock ();
+      lock_release (&fte->l);
+      continue;
+    }
 
-      /* No longer need the global lock .*/
-      lock_release (&frame_table_lock);
-      
-      bool success; 
-      block_sector_t sector_id = (block_sector_t) -1;
-
-      /* Must first set the page to be not present in page table
-        before checking the dirty bit.
-        This will prevent a race that another process is dirtying the
-        process. After setting not present, other processes wanting
-        to dirty this page will fault and load again. When they try to 
-        load again, since they can't get the frame lock, they must wait 
-        for this process to end evicting, thus preventing the race. */
-      pagedir_clear_page (spe_tmp->t->pagedir, spe_tmp->u_addr);
-
-      /* Write frame back to file/swap if necessary. */
-      if (spe_tmp->file != NULL) 
+    /* Check accessed bit. */
+    if (pagedir_is_accessed (spe_tmp->t->pagedir, spe_tmp->u_addr))
+    {
+      /* If it has been accessed recently, clear the access bit
+         and note the time of use. */
+      pagedir_set_accessed (spe_tmp->t->pagedir, spe_tmp->u_addr, false);
+      fte->last_used = spe_tmp->t->vtime;
+      lock_release (&fte->l);
+      continue;
+    }
+
+    /* Keep working sets, and dirty pages while clean ones may be
+       left. */
+    if ((pass < 2 && in_working_set (fte))
+      || (pass == 0 && needs_write (spe_tmp)))
+    {
+      if (pass == 0 && !in_working_set (fte))
+        dirty_seen = true;
+      lock_release (&fte->l);
+      continue;
+    }
+          
+    /* Try to evict this frame. */
+
+    /* Pages going to swap take other such pages with them,
+       making a page-out one sequential write. */
+    struct frame_table_entry *cluster[SWAP_CLUSTER - 1];
+    size_t cluster_cnt = 0;
+    if (goes_to_swap (spe_tmp))
+      cluster_cnt = gather_cluster (cluster);
+
+    /* No longer need the global lock .*/
+    lock_release (&frame_table_lock);
+    
+    bool success; 
+    block_sector_t sector_id = (block_sector_t) -1;
+
+    /* Must first set the page to be not present in page table
+      before checking the dirty bit.
+      This will prevent a race that another process is dirtying the
+      process. After setting not present, other processes wanting
+      to dirty this page will fault and load again. When they try to 
+      load again, since they can't get the frame lock, they must wait 
+      for this process to end evicting, thus preventing the race. */
+    pagedir_clear_page (spe_tmp->t->pagedir, spe_tmp->u_addr);
+
+    /* Write frame back to file/swap if necessary. */
+    if (spe_tmp->file != NULL) 
+    {
+      /* Check dirty bit. */
+      if (pagedir_is_dirty (spe_tmp->t->pagedir, spe_tmp->u_addr)) 
       {
-        /* Check dirty bit. */
-        if (pagedir_is_dirty (spe_tmp->t->pagedir, spe_tmp->u_addr)) 
+        if (spe_tmp->type == VM_EXECUTABLE_TYPE)
         {
-          if (spe_tmp->type == VM_EXECUTABLE_TYPE)
-          {
-            /* Modified excutable file page will be written to swap. */
-            success = (sector_id = swap_alloc (fte->k_addr)) != (block_sector_t) -1;
-          }
-          else
-          {
-            /* Modified mmap file page will be written to file. */
-            success = file_write_at (spe_tmp->file, fte->k_addr, spe_tmp->file_bytes,
-              spe_tmp->ofs) == (int) spe_tmp->file_bytes;
-          }
+          /* Modified excutable file page will be written to swap. */
+          sector_id = swap_out (fte, cluster, cluster_cnt);
+          cluster_cnt = 0;
+          success = sector_id != (block_sector_t) -1;
+          if (success)
+            count_eviction (EVICT_EXEC_DIRTY);
         }
         else
         {
-          /* Clean page, return directly. */
-          success = true;
+          /* Modified mmap file page will be written to file. */
+          success = file_write_at (spe_tmp->file, fte->k_addr, spe_tmp->file_bytes,
+            spe_tmp->ofs) == (int) spe_tmp->file_bytes;
+          if (success)
+            count_eviction (EVICT_MMAP_DIRTY);
         }
       }
       else
       {
-        /* Stack page, write it to swap. */
-        success = (sector_id = swap_alloc (fte->k_addr)) != (block_sector_t) -1;
+        /* Clean page, return directly. */
+        success = true;
+        count_eviction (spe_tmp->type == VM_EXECUTABLE_TYPE
+          ? EVICT_EXEC_CLEAN : EVICT_MMAP_CLEAN);
       }
+    }
+    else
+    {
+      /* Stack page, write it to swap. */
+      sector_id = swap_out (fte, cluster, cluster_cnt);
+      cluster_cnt = 0;
+      success = sector_id != (block_sector_t) -1;
+      if (success)
+        count_eviction (EVICT_STACK);
+    }
 
-      if (success) 
-      {
-        /* Evict successful. */
-        spe_tmp->fte = NULL;
-        spe_tmp->sector_id = sector_id;
-        fte->spe = spe;
-        return fte;
-      }
-      else
+    /* This page did not go to swap after all, swap out the
+       collected pages by themselves. */
+    if (cluster_cnt > 0)
+      swap_out (NULL, cluster, cluster_cnt);
+
+    if (success) 
+    {
+      /* Evict successful. */
+      spe_tmp->sector_id = sector_id;
+      barrier ();
+      spe_tmp->fte = NULL;
+      fte->spe = spe;
+      if (spe != NULL)
+        fte->last_used = spe->t->vtime;
+      return fte;
+    }
+    else
+    {
+      /* Can't evict this frame, try another one. */
+      lock_release (&fte->l);
+      lock_acquire (&frame_table_lock);
+    }
+  }
+  lock_release (&frame_table_lock);
+  return NULL;
+}
+
+/* Page-out daemon. */
+/* Sleeps until free frames drop below frames_low, then evicts
+   pages, writing dirty ones back, until there are frames_high
+   free frames again. This way page faults can usually take a
+   free frame without doing any I/O themselves. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+  for (;;)
+  {
+    lock_acquire (&free_frames_lock);
+    while (free_frame_cnt >= frames_low)
+      cond_wait (&pageout_wanted, &free_frames_lock);
+    lock_release (&free_frames_lock);
+
+    while (free_frame_cnt < frames_high)
+    {
+      struct frame_table_entry *fte = clock_evict (NULL);
+      if (fte == NULL)
       {
-        /* Can't evict this frame, try another one. */
-        lock_release (&fte->l);
-        lock_acquire (&frame_table_lock);
+        /* Nothing to evict now, try again later. */
+        timer_msleep (100);
+        break;
       }
+      free_frame (fte);
+      lock_release (&fte->l);
     }
-    lock_release (&frame_table_lock);
+  }
+}
+
+/* Try to allocate a frame for page. */
+/* Immediately lock it after allocation. */
+/* If no frame avaliable, try to evict one .*/
+/* Return NULL on failure. */
+struct frame_table_entry *
+frame_alloc_and_lock (struct spt_entry *spe)
+{
+	/* At most try 3 times .*/
+  int try_num;
+  for (try_num = 0 ; try_num < 3 ; try_num++)
+  {
+    /* First try to get free frame. */
+    struct frame_table_entry *fte = frame_try_alloc_and_lock (spe);
+    if (fte != NULL)
+      return fte;
+
+    /* If we don't have free frame, the daemon is behind, 
+       evict one ourselves. */
+    fte = clock_evict (spe);
+    if (fte != NULL)
+      return fte;
     timer_msleep (100);
   }
 	return NULL;
@@ -186,7 +596,19 @@ frame_release_and_free (struct frame_table_entry *fte)
 {	
   ASSERT (lock_held_by_current_thread (&fte->l));
   
-  fte->spe = NULL;
+  free_frame (fte);
   lock_release (&fte->l);
   return;
 }
+
+/* Print eviction statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Evictions: %llu stack, %llu executable clean, "
+          "%llu executable to swap, %llu mmap clean, %llu mmap written, "
+          "%llu unused readahead\n",
+          evict_cnt[EVICT_STACK], evict_cnt[EVICT_EXEC_CLEAN],
+          evict_cnt[EVICT_EXEC_DIRTY], evict_cnt[EVICT_MMAP_CLEAN],
+          evict_cnt[EVICT_MMAP_DIRTY], evict_cnt[EVICT_READAHEAD]);
+}
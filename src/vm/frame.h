@@ -16,10 +16,24 @@ struct frame_table_entry
 	/* Used for synchronization. */
 	/* see spt_lock_frame function in page.c */
 	struct lock l;
+
+	/* Free frame list membership, protected by free_frames_lock. */
+	struct list_elem free_elem;
+	bool free;
+
+	/* Virtual time of the page's owner when the page was last
+	   seen used. */
+	int64_t last_used;
+
+	/* Shared file page held in this frame, or NULL. */
+	/* If not NULL, spe is one of the pages mapping it. */
+	struct cached_page *cpage;
 };
 
 void frame_table_init (void);
 struct frame_table_entry* frame_alloc_and_lock (struct spt_entry *spe);
+struct frame_table_entry* frame_try_alloc_and_lock (struct spt_entry *spe);
+void frame_print_stats (void);
 void frame_release_and_free (struct frame_table_entry *fte);
 
 #endif
\ No newline at end of file
@@ -5,16 +5,29 @@
 #include "userprog/syscall.h"
 #include "filesys/file.h"
 #include "threads/vaddr.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "vm/page.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/pagecache.h"
+#include "vm/vma.h"
 
 static unsigned spt_hash_func (const struct hash_elem *e, void *aux UNUSED);
 static bool spt_less_func (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED);
 static void spt_destroy_func (struct hash_elem *e, void *aux UNUSED);
 
+/* A page of zeros, mapped read-only for reads of pages that
+   hold nothing yet, so that they don't take a frame until they
+   are written. Never evicted. */
+static uint8_t *zero_page;
+
+/* Number of pages mapped by fault-around, each one a fault
+   saved if the process goes on to use it. */
+static unsigned long long fault_around_cnt;
+
 static unsigned 
 spt_hash_func (const struct hash_elem *e,
 			       void *aux UNUSED)
@@ -41,6 +54,14 @@ spt_destroy_func (struct hash_elem *e, void *aux UNUSED)
 {
   struct spt_entry *spe = hash_entry (e, struct spt_entry, elem);
   
+  /* Shared file pages are freed with their last reference. */
+  if (spe->cpage != NULL)
+  {
+    pagecache_unmap (spe);
+    free (spe);
+    return;
+  }
+
   //printf(" hhe%x \n",(int)spe->fte);
   /* Must get lock of frame first. */
   spt_lock_frame (spe);
@@ -56,6 +77,13 @@ spt_destroy_func (struct hash_elem *e, void *aux UNUSED)
   free(spe);
 }
 
+/* Allocate the shared zero page. */
+void
+spt_zero_page_init (void)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
 /* Init the supplemental page table .*/ 
 bool
 spt_init (struct hash *spt_table)
@@ -69,6 +97,7 @@ void
 spt_destroy (struct hash *spt_table)
 {
   hash_destroy(spt_table, spt_destroy_func);
+  vma_destroy ();
 }
 
 /* Lock the page's frame. */
@@ -107,6 +136,9 @@ spt_add (int type, uint8_t *upage, bool writable, ...)
   spe->writable = writable;
   spe->fte = NULL;
   spe->sector_id = (block_sector_t) -1;
+  spe->prefetched = false;
+  spe->cpage = NULL;
+  spe->vma = NULL;
   spe->t = thread_current ();
 
   if (type == VM_EXECUTABLE_TYPE || type == VM_MMAP_TYPE)
@@ -153,6 +185,97 @@ struct spt_entry* spt_get(void *upage)
   return e != NULL ? hash_entry (e, struct spt_entry, elem) : NULL;
  }
 
+/* Return the number of bytes of vma's file that its page upage
+   holds, the rest of the page is zeros. */
+static uint32_t
+vma_file_bytes (struct vma *vma, uint8_t *upage)
+{
+  uint32_t skip = upage - vma->start;
+  if (skip >= vma->read_bytes)
+    return 0;
+  return vma->read_bytes - skip < PGSIZE ? vma->read_bytes - skip : PGSIZE;
+}
+
+/* Get the entry of upage from the supplemental page table, or
+   make it from the process's area holding upage if the page has
+   not been touched yet. */
+/* Return NULL if upage is in no area, or out of memory. */
+struct spt_entry *
+spt_lookup (void *upage)
+{
+  struct spt_entry *spe = spt_get (upage);
+  if (spe != NULL)
+    return spe;
+
+  struct vma *vma = vma_find (upage);
+  if (vma == NULL)
+    return NULL;
+  upage = pg_round_down (upage);
+  if (!spt_add (vma->type, upage, vma->writable, vma->file,
+    (int32_t) (vma->ofs + ((uint8_t *) upage - vma->start)),
+    vma_file_bytes (vma, upage)))
+    return NULL;
+
+  spe = spt_get (upage);
+  spe->vma = vma;
+  list_push_back (&vma->pages, &spe->vma_elem);
+  return spe;
+}
+
+/* Read the page of spe from swap into fte and free its slot. */
+/* Also read ahead the following pages of the process that were
+   swapped out to the following slots, into free frames, up to
+   the process's readahead window. The window grows when read
+   ahead pages get used and shrinks when they are evicted unused
+   (see frame_alloc_and_lock). */
+static void
+swap_in (struct spt_entry *spe, struct frame_table_entry *fte)
+{
+  struct thread *t = thread_current ();
+  struct spt_entry *ra_spe[SWAP_RA_MAX];
+  struct frame_table_entry *ra_fte[SWAP_RA_MAX];
+  uint8_t *addrs[SWAP_RA_MAX + 1];
+  block_sector_t sectors[SWAP_RA_MAX + 1];
+  int cnt = 0;
+  int i;
+
+  /* Sequential faults open a closed window again. */
+  if (t->swap_ra_window == 0 && spe->u_addr == t->last_swap_fault + PGSIZE)
+    t->swap_ra_window = 1;
+  t->last_swap_fault = spe->u_addr;
+
+  addrs[0] = fte->k_addr;
+  sectors[0] = spe->sector_id;
+  for (i = 1 ; i <= t->swap_ra_window ; i++)
+  {
+    struct spt_entry *next = spt_get (spe->u_addr + i * PGSIZE);
+    if (next == NULL || next->fte != NULL
+      || next->sector_id != spe->sector_id + i * SECTORS_PER_PAGE)
+      break;
+
+    /* Only use free frames, never evict for readahead. */
+    struct frame_table_entry *next_fte = frame_try_alloc_and_lock (next);
+    if (next_fte == NULL)
+      break;
+    ra_spe[cnt] = next;
+    ra_fte[cnt] = next_fte;
+    cnt++;
+    addrs[cnt] = next_fte->k_addr;
+    sectors[cnt] = next->sector_id;
+  }
+
+  swap_read_cluster (addrs, sectors, cnt + 1);
+  swap_clear (spe->sector_id);
+  spe->sector_id = (block_sector_t) -1;
+
+  for (i = 0 ; i < cnt ; i++)
+  {
+    ra_spe[i]->prefetched = true;
+    ra_spe[i]->fte = ra_fte[i];
+    lock_release (&ra_fte[i]->l);
+  }
+}
+
 /* Called by the page fault handler. */
 /* Load the physical frame. */ 
 /* Return true if succssful, false on failure .*/ 		  
@@ -160,10 +283,15 @@ bool
 spt_load_page (void *upage)
 {
   ASSERT (pg_ofs (upage) == 0); /* Upage must be aligned .*/
-  struct spt_entry *spe = spt_get (upage);
+  struct spt_entry *spe = spt_lookup (upage);
   if (spe == NULL)
     return false;
 
+  /* Read-only executable and mmap pages come from the page
+     cache. */
+  if (pagecache_shareable (spe))
+    return pagecache_load_page (spe);
+
   struct frame_table_entry *fte;
 
   /* First check whether the page is being evciting. */
@@ -187,17 +315,28 @@ spt_load_page (void *upage)
   bool need_to_set_dirty = false;
   
   /* load the frame. */
-  if(spe->sector_id != (block_sector_t) -1)
-  { 
-    /* Load this page from swap. */ 
-    swap_free (fte->k_addr, spe->sector_id);
+  if (spe->prefetched)
+  {
+    /* Already read ahead from swap, just free the slot. */
+    swap_clear (spe->sector_id);
     spe->sector_id = (block_sector_t) -1;
+    spe->prefetched = false;
+    if (spe->t->swap_ra_window < SWAP_RA_MAX)
+      spe->t->swap_ra_window++;
+
+    if(spe->type == VM_EXECUTABLE_TYPE)
+      need_to_set_dirty = true;
+  }
+  else if(spe->sector_id != (block_sector_t) -1)
+  { 
+    /* Load this page from swap, reading ahead. */ 
+    swap_in (spe, fte);
     
     /* The page need to be set dirty .*/
     if(spe->type == VM_EXECUTABLE_TYPE)
       need_to_set_dirty = true;
   }
-  else if (spe->file != NULL)
+  else if (spe->file != NULL && spe->file_bytes > 0)
   {
     /* Load this page from file. */  
     if (file_read_at (spe->file, fte->k_addr, spe->file_bytes, spe->ofs) 
@@ -227,3 +366,209 @@ spt_load_page (void *upage)
   ASSERT (!(spe->type == VM_MMAP_TYPE && spe->file_bytes == 0));
   return true;
 }
+
+/* Called by the page fault handler on a write to a present,
+   read-only page. */
+/* Give the page a private copy if it is copy-on-write. */
+/* Return true if successful, false on failure. */
+bool
+spt_write_page (void *upage)
+{
+  ASSERT (pg_ofs (upage) == 0); /* Upage must be aligned .*/
+  struct spt_entry *spe = spt_get (upage);
+  if (spe == NULL || !spe->writable)
+    return false;
+
+  /* First write to a page read as zeros, give it a frame. */
+  if (spe->fte == NULL 
+    && pagedir_get_page (spe->t->pagedir, upage) == zero_page)
+  {
+    pagedir_clear_page (spe->t->pagedir, upage);
+    return spt_load_page (upage);
+  }
+  return pagecache_break_cow (spe);
+}
+
+/* Return the file of the current process's mapping that starts
+   at upage, or a null pointer if there is none.  Matching the
+   start alone does not depend on the mapping's page count. */
+static struct file *
+mmap_file_at (uint8_t *upage)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mmap_list); e != list_end (&t->mmap_list);
+    e = list_next (e))
+  {
+    struct mmap_file *mmap = list_entry (e, struct mmap_file, elem);
+    if (mmap->addr == upage)
+      return mmap->file;
+  }
+  return NULL;
+}
+
+/* Copy the areas and supplemental page table of parent, whose
+   process forked the current one, which has copies of its
+   executable and mmaps already. */
+/* Pages with data of their own become copy-on-write, the others
+   are loaded again by the child from its areas. */
+/* Return true if succssful, false on failure .*/
+bool
+spt_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->vma_list); e != list_end (&parent->vma_list);
+    e = list_next (e))
+  {
+    struct vma *pvma = list_entry (e, struct vma, elem);
+    struct file *file = pvma->type == VM_MMAP_TYPE 
+      ? mmap_file_at (pvma->start) : t->exec_file;
+    if (file == NULL)
+      return false;
+    if (!vma_add (pvma->type, pvma->start, (pvma->end - pvma->start) / PGSIZE,
+      pvma->writable, file, pvma->ofs, pvma->read_bytes))
+      return false;
+  }
+
+  hash_first (&i, &parent->spt_table);
+  while (hash_next (&i))
+  {
+    struct spt_entry *pspe = hash_entry (hash_cur (&i), struct spt_entry, elem);
+    struct spt_entry *spe;
+    bool anonymous;
+
+    /* A page of its own is a stack page or a writable executable
+       page that has been loaded, possibly shared with a process
+       forked before.  A private page is classified under its
+       frame lock, so that the pageout daemon can't be halfway
+       through evicting it; eviction stores the swap slot before
+       it clears the frame. */
+    anonymous = pspe->type != VM_MMAP_TYPE && pspe->writable;
+    if (anonymous && pspe->cpage == NULL)
+    {
+      spt_lock_frame (pspe);
+      anonymous = pspe->fte != NULL
+        || pspe->sector_id != (block_sector_t) -1;
+      if (pspe->fte != NULL)
+        lock_release (&pspe->fte->l);
+    }
+
+    if (pspe->vma == NULL)
+    {
+      if (!spt_add (pspe->type, pspe->u_addr, pspe->writable))
+        return false;
+      spe = spt_get (pspe->u_addr);
+    }
+    else if (anonymous)
+    {
+      spe = spt_lookup (pspe->u_addr);
+      if (spe == NULL)
+        return false;
+    }
+    else
+      continue;
+
+    if (anonymous && !pagecache_share (pspe, spe))
+      return false;
+  }
+  return true;
+}
+
+/* Return true if spe's page holds only zeros so far, that is if
+   it is a stack or bss page that has never been written. */
+static bool
+is_zero_fill (struct spt_entry *spe)
+{
+  return spe->type != VM_MMAP_TYPE && spe->file_bytes == 0
+    && spe->fte == NULL && spe->cpage == NULL 
+    && spe->sector_id == (block_sector_t) -1;
+}
+
+/* Read the private file page spe into a free frame and map it.
+   Return true if successful, false if no frame is free. */
+static bool
+load_around_private (struct spt_entry *spe)
+{
+  struct frame_table_entry *fte = frame_try_alloc_and_lock (spe);
+  if (fte == NULL)
+    return false;
+
+  if (file_read_at (spe->file, fte->k_addr, spe->file_bytes, spe->ofs) 
+    != (int) spe->file_bytes
+    || !install_page (spe->u_addr, fte->k_addr, spe->writable))
+  {
+    frame_release_and_free (fte);
+    return false;
+  }
+  memset (fte->k_addr + spe->file_bytes, 0, PGSIZE - spe->file_bytes);
+  spe->fte = fte;
+  lock_release (&fte->l);
+  return true;
+}
+
+/* Map the pages of the same area as spe, which was just faulted
+   in, in the aligned group of FAULT_AROUND pages holding it, so
+   that the process does not fault on them one by one. */
+/* Only pages that are in the page cache already, or that a free
+   frame can be read into, are mapped. The file reads go through
+   the buffer cache, right after the faulting one. */
+static void
+fault_around (struct spt_entry *spe)
+{
+  uint8_t *start = spe->u_addr - pg_no (spe->u_addr) % FAULT_AROUND * PGSIZE;
+  int i;
+
+  for (i = 0 ; i < FAULT_AROUND ; i++)
+  {
+    uint8_t *upage = start + i * PGSIZE;
+    if (upage < spe->vma->start || upage >= spe->vma->end
+      || upage == spe->u_addr || vma_file_bytes (spe->vma, upage) == 0)
+      continue;
+
+    struct spt_entry *next = spt_lookup (upage);
+    if (next == NULL || next->fte != NULL || next->sector_id != (block_sector_t) -1
+      || pagedir_get_page (next->t->pagedir, next->u_addr) != NULL)
+      continue;
+
+    bool mapped = pagecache_shareable (next) 
+      ? pagecache_load_around (next) : load_around_private (next);
+    if (mapped)
+    {
+      enum intr_level old_level = intr_disable ();
+      fault_around_cnt++;
+      intr_set_level (old_level);
+    }
+  }
+}
+
+/* Called by the page fault handler on a fault on a page that is
+   not present. WRITE tells whether the access was a write. */
+/* Reads of pages holding only zeros map the shared zero page,
+   anything else loads the page. */
+/* Return true if succssful, false on failure .*/
+bool
+spt_fault_page (void *upage, bool write)
+{
+  ASSERT (pg_ofs (upage) == 0); /* Upage must be aligned .*/
+  struct spt_entry *spe = spt_lookup (upage);
+  if (spe == NULL)
+    return false;
+  if (!write && is_zero_fill (spe))
+    return install_page (upage, zero_page, false);
+  if (!spt_load_page (upage))
+    return false;
+  if (spe->type == VM_EXECUTABLE_TYPE || spe->type == VM_MMAP_TYPE)
+    fault_around (spe);
+  return true;
+}
+
+/* Print fault-around statistics. */
+void
+spt_print_stats (void)
+{
+  printf ("Fault-around: %llu pages mapped\n", fault_around_cnt);
+}
@@ -6,10 +6,19 @@
 #include "devices/block.h"
 #include "threads/thread.h"
 
+struct vma;
+
 #define VM_EXECUTABLE_TYPE 1 /* Type for executable file. */
 #define VM_MMAP_TYPE 2 /* Type for mmap file. */
 #define VM_STACK_TYPE 3 /* Type for stack page. */
 
+/* Most pages read ahead on a swap fault. */
+#define SWAP_RA_MAX 8
+
+/* File pages are mapped in aligned groups of this many pages
+   around a faulting one, see spt_fault_page. */
+#define FAULT_AROUND 8
+
 struct spt_entry
 {
 	int type;						/* Page type. */
@@ -32,13 +41,31 @@ struct spt_entry
 	/* If the frame is not in swap, sector_id = (block_sector_t) -1. */
 	block_sector_t sector_id;
 
+	/* True if the page was read ahead from swap and hasn't been
+	   used yet. It then has both a frame and a swap slot. */
+	bool prefetched;
+
+	/* Shared file page this page refers to, or NULL until first
+	   loaded. See vm/pagecache.c. */
+	struct cached_page *cpage;
+	struct list_elem cpage_elem;
+
+	/* Area the page belongs to, NULL for stack pages. */
+	struct vma *vma;
+	struct list_elem vma_elem; /* Elem used for vma's pages. */
 };
 
+void spt_zero_page_init (void);
 bool spt_init(struct hash *spt_table);
 void spt_destroy(struct hash *spt_table);
 bool spt_add (int type, uint8_t *upage, bool writable, ...);
 struct spt_entry* spt_get(void *upage);
+struct spt_entry *spt_lookup (void *upage);
 bool spt_load_page(void *upage);
+bool spt_fault_page (void *upage, bool write);
+bool spt_write_page (void *upage);
+bool spt_fork (struct thread *parent);
 void spt_lock_frame (struct spt_entry *spe);
+void spt_print_stats (void);
 
 #endif
@@ -0,0 +1,855 @@
+#include <hash.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/pagecache.h"
+#include "vm/swap.h"
+
+/* Page cache for file pages mapped by processes. */
+/* All processes running the same executable map each of its
+   read-only pages from one frame, and all processes mapping the
+   same file with mmap map each of its pages from one frame. A
+   cached_page stands for one such page of one file, and lists
+   the pages of the supplemental page tables referring to it, so
+   that eviction can unmap it from all of them. */
+/* The frame's spe is one of these, used for the clock. */
+/* fork shares the anonymous pages of a process with its child
+   the same way, through cached pages without a file that are
+   mapped read-only and go to swap when evicted. The first write
+   through a mapping gives it a private copy (copy-on-write). */
+/* read and write go to the buffer cache, but also look here, so
+   they see what processes stored through mmap and processes see
+   what they write. write patches a page in memory both before and
+   after updating the buffer cache, and waits for the page to be
+   read in or written back, so that neither can put older data
+   over what it wrote. */
+/* A flusher thread writes modified mmap pages back every
+   FLUSH_INTERVAL, keeping them in memory, so that eviction,
+   munmap and exit rarely find a page to write. */
+
+/* Ticks between two runs of the flusher. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+struct cached_page
+{
+  struct inode *inode;    /* File, or NULL if anonymous. */
+  off_t ofs;              /* Offset of the page in the file. */
+  bool mmap;              /* Mapped with mmap, not executable text? */
+  struct hash_elem elem;  /* Element in cached_pages. */
+
+  /* Bytes of the page backed by the file, the rest is zero. */
+  uint32_t bytes;
+
+  /* Frame holding the page, or NULL if not in memory. */
+  struct frame_table_entry *fte;
+
+  /* All spt_entry's referring to this page. */
+  struct list mappings;
+
+  /* Is a process reading the page in, or writing it back? */
+  bool loading;
+
+  /* Modified through a mapping that is gone, so the frame must be
+     written back to the file. */
+  bool dirty;
+
+  /* Swap slot of an anonymous page not in memory, or
+     (block_sector_t) -1. */
+  block_sector_t sector_id;
+
+  /* Thread writing the page back, or NULL. If the page stays in
+     memory meanwhile, the frame can't be evicted or freed. */
+  struct thread *writer;
+
+  /* Element in mmap_pages, if an mmap page in memory. */
+  struct list_elem mmap_elem;
+};
+
+/* All cached file pages, by inode, offset and kind. */
+static struct hash cached_pages;
+
+/* Protects cached_pages, the cached_page's and the cpage members
+   of spt_entry's and frames. May be acquired while holding a
+   frame lock only with pagecache_try_lock, or when nobody else
+   can lock that frame, to avoid deadlock with pagecache_unmap. */
+static struct lock cache_lock;
+
+/* Broadcast when a cached page is done loading or writing back. */
+static struct condition page_loaded;
+
+/* The mmap pages in memory. */
+static struct list mmap_pages;
+
+/* Number of cached mmap pages, in memory or not. Read without
+   cache_lock to spare file I/O the lookup while nothing is
+   mapped. */
+static int mmap_cached_cnt;
+
+static thread_func flusher NO_RETURN;
+
+static unsigned
+pagecache_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct cached_page *cp = hash_entry (e, struct cached_page, elem);
+  return hash_bytes (&cp->inode, sizeof cp->inode)
+    ^ hash_int (cp->ofs) ^ cp->mmap;
+}
+
+static bool
+pagecache_less_func (const struct hash_elem *a, const struct hash_elem *b,
+  void *aux UNUSED)
+{
+  struct cached_page *cp_a = hash_entry (a, struct cached_page, elem);
+  struct cached_page *cp_b = hash_entry (b, struct cached_page, elem);
+  if (cp_a->inode != cp_b->inode)
+    return cp_a->inode < cp_b->inode;
+  if (cp_a->ofs != cp_b->ofs)
+    return cp_a->ofs < cp_b->ofs;
+  return cp_a->mmap < cp_b->mmap;
+}
+
+/* Init the page cache. */
+void
+pagecache_init (void)
+{
+  hash_init (&cached_pages, pagecache_hash_func, pagecache_less_func, NULL);
+  lock_init (&cache_lock);
+  cond_init (&page_loaded);
+  list_init (&mmap_pages);
+  mmap_cached_cnt = 0;
+  thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+}
+
+/* Return the cached page of inode at ofs, or NULL. */
+/* Must hold cache_lock. */
+static struct cached_page *
+lookup (struct inode *inode, off_t ofs, bool mmap)
+{
+  struct cached_page key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.mmap = mmap;
+  e = hash_find (&cached_pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct cached_page, elem) : NULL;
+}
+
+/* Return true if spe's page is shared with other processes
+   through the page cache. */
+bool
+pagecache_shareable (struct spt_entry *spe)
+{
+  struct cached_page *cp;
+  bool shareable;
+
+  if (spe->cpage != NULL)
+    return true;
+  if (spe->type == VM_EXECUTABLE_TYPE)
+    return !spe->writable;
+  if (spe->type != VM_MMAP_TYPE)
+    return false;
+
+  /* The last page of a file that grew since others mapped it
+     holds more of the file, so it is kept private. */
+  lock_acquire (&cache_lock);
+  cp = lookup (file_get_inode (spe->file), spe->ofs, true);
+  shareable = cp == NULL || cp->bytes == spe->file_bytes;
+  lock_release (&cache_lock);
+  return shareable;
+}
+
+/* Find or create the cached page for spe and add spe to its
+   mappings. Return NULL if out of memory. */
+/* Must hold cache_lock. */
+static struct cached_page *
+pagecache_get (struct spt_entry *spe)
+{
+  struct inode *inode = file_get_inode (spe->file);
+  bool mmap = spe->type == VM_MMAP_TYPE;
+  struct cached_page *cp;
+
+  cp = lookup (inode, spe->ofs, mmap);
+  if (cp == NULL)
+  {
+    cp = malloc (sizeof *cp);
+    if (cp == NULL)
+      return NULL;
+    cp->inode = inode_reopen (inode);
+    cp->ofs = spe->ofs;
+    cp->mmap = mmap;
+    cp->bytes = spe->file_bytes;
+    cp->fte = NULL;
+    list_init (&cp->mappings);
+    cp->loading = false;
+    cp->dirty = false;
+    cp->sector_id = (block_sector_t) -1;
+    cp->writer = NULL;
+    hash_insert (&cached_pages, &cp->elem);
+    if (mmap)
+      mmap_cached_cnt++;
+  }
+  else if (cp->bytes != spe->file_bytes)
+    return NULL;
+  list_push_back (&cp->mappings, &spe->cpage_elem);
+  spe->cpage = cp;
+  return cp;
+}
+
+/* Free cp if nothing refers to it any more. Return its inode,
+   to be closed after releasing cache_lock, or NULL. */
+/* Must hold cache_lock. */
+static struct inode *
+release_if_unused (struct cached_page *cp)
+{
+  struct inode *inode;
+
+  if (!list_empty (&cp->mappings) || cp->loading)
+    return NULL;
+  if (cp->inode != NULL)
+    hash_delete (&cached_pages, &cp->elem);
+  if (cp->mmap)
+    mmap_cached_cnt--;
+  if (cp->sector_id != (block_sector_t) -1)
+    swap_clear (cp->sector_id);
+  inode = cp->inode;
+  free (cp);
+  return inode;
+}
+
+/* Take cp out of its frame. */
+/* Must hold cache_lock and the frame's lock. */
+static void
+unpublish (struct cached_page *cp)
+{
+  ASSERT (cp->writer == NULL);
+  cp->fte->cpage = NULL;
+  cp->fte = NULL;
+  if (cp->mmap)
+    list_remove (&cp->mmap_elem);
+}
+
+/* Load the shared page spe, mapping the frame that holds it if
+   another process has it in memory, otherwise reading it into a
+   new frame. Return true if successful. */
+/* If AROUND, spe is near a page just faulted in and is only
+   loaded if that takes no waiting: it is a file page that is in
+   memory, or a frame is free to read it into. */
+static bool
+load_page (struct spt_entry *spe, bool around)
+{
+  struct cached_page *cp;
+  struct frame_table_entry *fte;
+
+  ASSERT (spe->t == thread_current ());
+
+  lock_acquire (&cache_lock);
+  cp = spe->cpage != NULL ? spe->cpage : pagecache_get (spe);
+  if (cp == NULL || (around && (cp->inode == NULL || cp->loading)))
+  {
+    lock_release (&cache_lock);
+    return false;
+  }
+  for (;;)
+  {
+    while (cp->loading)
+      cond_wait (&page_loaded, &cache_lock);
+    if (cp->fte != NULL)
+      break;
+
+    /* A free frame is not in the cache, so taking it is safe. */
+    fte = NULL;
+    if (around)
+    {
+      fte = frame_try_alloc_and_lock (spe);
+      if (fte == NULL)
+      {
+        lock_release (&cache_lock);
+        return false;
+      }
+    }
+
+    /* Read the page in without cache_lock, others wait for us. */
+    cp->loading = true;
+    lock_release (&cache_lock);
+
+    if (fte == NULL)
+      fte = frame_alloc_and_lock (spe);
+    bool success = fte != NULL;
+    if (success && cp->inode == NULL)
+    {
+      swap_free (fte->k_addr, cp->sector_id);
+      cp->sector_id = (block_sector_t) -1;
+    }
+    else if (success)
+    {
+      success = spe->file_bytes == 0
+        || file_read_at (spe->file, fte->k_addr, spe->file_bytes,
+             spe->ofs) == (int) spe->file_bytes;
+      if (success)
+        memset (fte->k_addr + spe->file_bytes, 0, PGSIZE - spe->file_bytes);
+      else
+        frame_release_and_free (fte);
+    }
+
+    /* The frame is ours alone until cache_lock publishes it, so
+       holding its lock while acquiring cache_lock is safe. */
+    lock_acquire (&cache_lock);
+    cp->loading = false;
+    cond_broadcast (&page_loaded, &cache_lock);
+    if (!success)
+    {
+      lock_release (&cache_lock);
+      return false;
+    }
+    cp->fte = fte;
+    fte->cpage = cp;
+    if (cp->mmap)
+      list_push_back (&mmap_pages, &cp->mmap_elem);
+    lock_release (&fte->l);
+  }
+
+  /* Eviction needs cache_lock, so the frame stays put. */
+  /* Anonymous pages are copy-on-write. */
+  fte = cp->fte;
+  if (!install_page (spe->u_addr, fte->k_addr,
+    cp->inode != NULL && spe->writable))
+  {
+    lock_release (&cache_lock);
+    return false;
+  }
+  spe->fte = fte;
+  lock_release (&cache_lock);
+  return true;
+}
+
+/* Load the shared page spe. Return true if successful. */
+bool
+pagecache_load_page (struct spt_entry *spe)
+{
+  return load_page (spe, false);
+}
+
+/* Load the shared page spe, near a page just faulted in, if that
+   takes no waiting. Return true if spe was mapped. */
+bool
+pagecache_load_around (struct spt_entry *spe)
+{
+  return load_page (spe, true);
+}
+
+/* Drop spe's reference to its cached page, unmapping it from
+   the process. Free the frame and the cached page when the last
+   reference goes, after writing the page back if it was
+   modified. */
+void
+pagecache_unmap (struct spt_entry *spe)
+{
+  struct cached_page *cp = spe->cpage;
+  struct frame_table_entry *fte;
+  struct inode *inode;
+  bool write_back = false;
+
+  lock_acquire (&cache_lock);
+  while (cp->writer != NULL)
+    cond_wait (&page_loaded, &cache_lock);
+  list_remove (&spe->cpage_elem);
+  spe->cpage = NULL;
+
+  fte = cp->fte;
+  if (fte != NULL)
+  {
+    lock_acquire (&fte->l);
+    if (spe->fte == fte)
+    {
+      /* Keep what the process stored before it goes. */
+      pagedir_clear_page (spe->t->pagedir, spe->u_addr);
+      if (pagedir_is_dirty (spe->t->pagedir, spe->u_addr))
+        cp->dirty = true;
+    }
+    if (list_empty (&cp->mappings))
+    {
+      unpublish (cp);
+      write_back = cp->inode != NULL && cp->dirty;
+      if (write_back)
+      {
+        cp->loading = true;
+        cp->writer = thread_current ();
+      }
+    }
+    else
+    {
+      if (fte->spe == spe)
+        fte->spe = list_entry (list_front (&cp->mappings),
+          struct spt_entry, cpage_elem);
+      lock_release (&fte->l);
+      fte = NULL;
+    }
+  }
+  spe->fte = NULL;
+  inode = release_if_unused (cp);
+  lock_release (&cache_lock);
+
+  /* Nobody can find the frame any more. */
+  if (write_back)
+    pagecache_write_back (cp, fte);
+  if (fte != NULL)
+    frame_release_and_free (fte);
+  if (inode != NULL)
+    inode_close (inode);
+}
+
+/* Try to acquire cache_lock, for use while holding a frame lock. */
+bool
+pagecache_try_lock (void)
+{
+  return lock_try_acquire (&cache_lock);
+}
+
+/* Release cache_lock. */
+void
+pagecache_unlock (void)
+{
+  lock_release (&cache_lock);
+}
+
+/* Return true if the cached page in fte has been accessed
+   through any mapping, and clear the accessed bits. */
+/* Must hold cache_lock and the frame's lock. */
+bool
+pagecache_accessed (struct frame_table_entry *fte)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (e = list_begin (&fte->cpage->mappings);
+    e != list_end (&fte->cpage->mappings); e = list_next (e))
+  {
+    struct spt_entry *spe = list_entry (e, struct spt_entry, cpage_elem);
+    if (spe->fte == fte
+      && pagedir_is_accessed (spe->t->pagedir, spe->u_addr))
+    {
+      pagedir_set_accessed (spe->t->pagedir, spe->u_addr, false);
+      accessed = true;
+    }
+  }
+  return accessed;
+}
+
+/* Return true if the cached page in fte must be written back
+   before the frame can be reused. */
+/* Must hold cache_lock and the frame's lock. */
+bool
+pagecache_dirty (struct frame_table_entry *fte)
+{
+  struct cached_page *cp = fte->cpage;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  if (cp->inode == NULL || cp->dirty)
+    return true;
+  for (e = list_begin (&cp->mappings); e != list_end (&cp->mappings);
+    e = list_next (e))
+  {
+    struct spt_entry *spe = list_entry (e, struct spt_entry, cpage_elem);
+    if (spe->fte == fte && pagedir_is_dirty (spe->t->pagedir, spe->u_addr))
+      return true;
+  }
+  return false;
+}
+
+/* Unmap the cached page in fte from every process. If the page
+   is clean, the frame can be reused right away and NULL is
+   returned. Otherwise the page is returned, and the caller must
+   pass it to pagecache_write_back before reusing the frame. */
+/* Must hold cache_lock and the frame's lock. */
+struct cached_page *
+pagecache_evict (struct frame_table_entry *fte)
+{
+  struct cached_page *cp = fte->cpage;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (e = list_begin (&cp->mappings); e != list_end (&cp->mappings);
+    e = list_next (e))
+  {
+    struct spt_entry *spe = list_entry (e, struct spt_entry, cpage_elem);
+    if (spe->fte == fte)
+    {
+      /* Not present first, so the dirty bit can't change. */
+      pagedir_clear_page (spe->t->pagedir, spe->u_addr);
+      if (pagedir_is_dirty (spe->t->pagedir, spe->u_addr))
+        cp->dirty = true;
+      spe->fte = NULL;
+    }
+  }
+  unpublish (cp);
+  if (cp->inode != NULL && !cp->dirty)
+    return NULL;
+
+  /* Processes faulting on the page wait until it is on disk. */
+  cp->loading = true;
+  cp->writer = thread_current ();
+  return cp;
+}
+
+/* Write cp, taken out of fte by pagecache_evict or the last
+   pagecache_unmap, back to its file, or an anonymous page to
+   swap. Return false if swap is full, in which case the page
+   stays in fte and the frame can't be reused. */
+/* Must hold the frame's lock, but not cache_lock. */
+bool
+pagecache_write_back (struct cached_page *cp, struct frame_table_entry *fte)
+{
+  block_sector_t sector_id = (block_sector_t) -1;
+  struct inode *inode;
+  bool success = true;
+
+  ASSERT (cp->loading && cp->writer == thread_current ());
+  if (cp->inode != NULL)
+    inode_write_at (cp->inode, fte->k_addr, cp->bytes, cp->ofs);
+  else
+  {
+    sector_id = swap_alloc (fte->k_addr);
+    success = sector_id != (block_sector_t) -1;
+  }
+
+  lock_acquire (&cache_lock);
+  cp->loading = false;
+  cp->writer = NULL;
+  cp->dirty = false;
+  cp->sector_id = sector_id;
+  if (!success && !list_empty (&cp->mappings))
+  {
+    /* The mappings fault it back in from the frame. */
+    cp->fte = fte;
+    fte->cpage = cp;
+  }
+  else
+    success = true;
+  cond_broadcast (&page_loaded, &cache_lock);
+  inode = release_if_unused (cp);
+  lock_release (&cache_lock);
+
+  if (inode != NULL)
+    inode_close (inode);
+  return success;
+}
+
+/* Make the private page PARENT, which is in memory or in swap,
+   copy-on-write and share it with CHILD, the page at the same
+   address in a process forked from PARENT's. Return true if
+   successful. */
+/* PARENT's process must not run meanwhile. */
+bool
+pagecache_share (struct spt_entry *parent, struct spt_entry *child)
+{
+  struct cached_page *cp = parent->cpage;
+  struct frame_table_entry *fte;
+
+  if (cp != NULL)
+  {
+    ASSERT (cp->inode == NULL);
+    lock_acquire (&cache_lock);
+    list_push_back (&cp->mappings, &child->cpage_elem);
+    child->cpage = cp;
+    lock_release (&cache_lock);
+    return true;
+  }
+
+  cp = malloc (sizeof *cp);
+  if (cp == NULL)
+    return false;
+  cp->inode = NULL;
+  cp->ofs = 0;
+  cp->mmap = false;
+  cp->bytes = PGSIZE;
+  cp->fte = NULL;
+  list_init (&cp->mappings);
+  cp->loading = false;
+  cp->dirty = false;
+  cp->sector_id = (block_sector_t) -1;
+  cp->writer = NULL;
+
+  /* The frame is not in the cache yet, so holding its lock while
+     acquiring cache_lock is safe. */
+  spt_lock_frame (parent);
+  fte = parent->fte;
+  if (parent->prefetched)
+  {
+    swap_clear (parent->sector_id);
+    parent->sector_id = (block_sector_t) -1;
+    parent->prefetched = false;
+  }
+  if (fte != NULL)
+  {
+    /* From now on PARENT writes fault too. */
+    pagedir_clear_page (parent->t->pagedir, parent->u_addr);
+    pagedir_set_page (parent->t->pagedir, parent->u_addr, fte->k_addr,
+      false);
+  }
+  else
+  {
+    cp->sector_id = parent->sector_id;
+    parent->sector_id = (block_sector_t) -1;
+  }
+
+  lock_acquire (&cache_lock);
+  cp->fte = fte;
+  if (fte != NULL)
+    fte->cpage = cp;
+  list_push_back (&cp->mappings, &parent->cpage_elem);
+  parent->cpage = cp;
+  list_push_back (&cp->mappings, &child->cpage_elem);
+  child->cpage = cp;
+  lock_release (&cache_lock);
+
+  if (fte != NULL)
+    lock_release (&fte->l);
+  return true;
+}
+
+/* Give spe a private, writable copy of its copy-on-write page,
+   which the process just tried to write. Return false if spe's
+   page is not copy-on-write or out of memory. */
+bool
+pagecache_break_cow (struct spt_entry *spe)
+{
+  struct cached_page *cp = spe->cpage;
+  struct frame_table_entry *fte;
+
+  if (cp == NULL || cp->inode != NULL)
+    return false;
+
+  lock_acquire (&cache_lock);
+  while (cp->loading)
+    cond_wait (&page_loaded, &cache_lock);
+  if (cp->fte == NULL || spe->fte != cp->fte)
+  {
+    /* Evicted meanwhile, fault it in again. */
+    lock_release (&cache_lock);
+    return true;
+  }
+
+  if (list_size (&cp->mappings) == 1)
+  {
+    /* Nobody else uses the page any more, take its frame. */
+    fte = cp->fte;
+    lock_acquire (&fte->l);
+    pagedir_clear_page (spe->t->pagedir, spe->u_addr);
+    unpublish (cp);
+    list_remove (&spe->cpage_elem);
+    spe->cpage = NULL;
+    release_if_unused (cp);
+    lock_release (&cache_lock);
+  }
+  else
+  {
+    lock_release (&cache_lock);
+    fte = frame_alloc_and_lock (spe);
+    if (fte == NULL)
+      return false;
+
+    /* The page can't change, all its mappings are read-only. */
+    lock_acquire (&cache_lock);
+    if (cp->fte == NULL)
+    {
+      lock_release (&cache_lock);
+      frame_release_and_free (fte);
+      return true;
+    }
+    memcpy (fte->k_addr, cp->fte->k_addr, PGSIZE);
+    lock_release (&cache_lock);
+    pagecache_unmap (spe);
+  }
+
+  fte->spe = spe;
+  spe->fte = fte;
+  if (!install_page (spe->u_addr, fte->k_addr, true))
+  {
+    spe->fte = NULL;
+    frame_release_and_free (fte);
+    return false;
+  }
+
+  /* The copy differs from the file, so it must go to swap. */
+  pagedir_set_dirty (spe->t->pagedir, spe->u_addr, true);
+  lock_release (&fte->l);
+  return true;
+}
+
+/* Return the mmap page holding SIZE bytes of INODE at OFFSET,
+   if it is in memory. The bytes may not cross a page. */
+/* Must hold cache_lock. */
+static struct cached_page *
+resident_page (struct inode *inode, off_t offset, off_t size)
+{
+  off_t page_ofs = offset % PGSIZE;
+  struct cached_page *cp = lookup (inode, offset - page_ofs, true);
+
+  ASSERT (page_ofs + size <= PGSIZE);
+  if (cp == NULL || cp->fte == NULL
+    || page_ofs + size > (off_t) cp->bytes)
+    return NULL;
+  return cp;
+}
+
+/* Copy SIZE bytes of INODE at OFFSET into BUFFER from the frame
+   of a process mapping them, if any. Return true if successful,
+   false if the caller must read the file. */
+/* BUFFER may be in user memory, so it is not touched while
+   holding cache_lock, which a page fault may need. */
+bool
+pagecache_read (struct inode *inode, off_t offset, void *buffer, off_t size)
+{
+  struct cached_page *cp;
+  uint8_t *bounce;
+
+  if (mmap_cached_cnt == 0)
+    return false;
+  bounce = malloc (size);
+  if (bounce == NULL)
+    return false;
+
+  lock_acquire (&cache_lock);
+  cp = resident_page (inode, offset, size);
+  if (cp != NULL)
+    memcpy (bounce, cp->fte->k_addr + offset % PGSIZE, size);
+  lock_release (&cache_lock);
+
+  if (cp != NULL)
+    memcpy (buffer, bounce, size);
+  free (bounce);
+  return cp != NULL;
+}
+
+/* Copy SIZE bytes from BUFFER, being written to INODE at OFFSET,
+   into the frame of the processes mapping them, if any. */
+/* Called both before and after the bytes go to the buffer cache.
+   Before, so that a write back of the frame, which waits for
+   nothing, carries them too. After, for a page read in from the
+   old data meanwhile. Waits for the page to be read in or
+   written back first, unless by the current thread. */
+void
+pagecache_write (struct inode *inode, off_t offset, const void *buffer,
+  off_t size)
+{
+  struct cached_page *cp;
+  uint8_t *bounce;
+
+  if (mmap_cached_cnt == 0)
+    return;
+  bounce = malloc (size);
+  if (bounce == NULL)
+    return;
+  memcpy (bounce, buffer, size);
+
+  lock_acquire (&cache_lock);
+  cp = lookup (inode, offset - offset % PGSIZE, true);
+  while (cp != NULL && cp->loading && cp->writer != thread_current ())
+  {
+    cond_wait (&page_loaded, &cache_lock);
+    cp = lookup (inode, offset - offset % PGSIZE, true);
+  }
+
+  /* The writer of a page back has its data already. Otherwise
+     the page must be written back again, in case the writer
+     copied the old data meanwhile. */
+  cp = resident_page (inode, offset, size);
+  if (cp != NULL && cp->writer != thread_current ())
+  {
+    memcpy (cp->fte->k_addr + offset % PGSIZE, bounce, size);
+    cp->dirty = true;
+  }
+  lock_release (&cache_lock);
+
+  free (bounce);
+}
+
+/* Return true if the cached page in fte is being written back
+   and can't be evicted. */
+/* Must hold cache_lock. */
+bool
+pagecache_writing (struct frame_table_entry *fte)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  return fte->cpage->writer != NULL;
+}
+
+/* Write the mmap page cp back to its file if any process
+   modified it, keeping it in memory and mapped. Clears the
+   dirty bits first, so stores made meanwhile set them again. */
+/* Must hold cache_lock, which is released during the write. */
+static void
+clean_page (struct cached_page *cp)
+{
+  struct frame_table_entry *fte = cp->fte;
+  struct list_elem *e;
+  bool dirty = cp->dirty;
+
+  ASSERT (cp->mmap);
+  if (fte == NULL || cp->writer != NULL)
+    return;
+  for (e = list_begin (&cp->mappings); e != list_end (&cp->mappings);
+    e = list_next (e))
+  {
+    struct spt_entry *spe = list_entry (e, struct spt_entry, cpage_elem);
+    if (spe->fte == fte && pagedir_is_dirty (spe->t->pagedir, spe->u_addr))
+    {
+      pagedir_set_dirty (spe->t->pagedir, spe->u_addr, false);
+      dirty = true;
+    }
+  }
+  if (!dirty)
+    return;
+
+  cp->dirty = false;
+  cp->writer = thread_current ();
+  lock_release (&cache_lock);
+  inode_write_at (cp->inode, fte->k_addr, cp->bytes, cp->ofs);
+  lock_acquire (&cache_lock);
+  cp->writer = NULL;
+  cond_broadcast (&page_loaded, &cache_lock);
+}
+
+/* Write the mmap page spe back to its file if modified, waiting
+   for a write by the flusher in progress, for msync. */
+void
+pagecache_clean (struct spt_entry *spe)
+{
+  struct cached_page *cp = spe->cpage;
+
+  ASSERT (cp != NULL && cp->mmap);
+  lock_acquire (&cache_lock);
+  while (cp->writer != NULL)
+    cond_wait (&page_loaded, &cache_lock);
+  clean_page (cp);
+  lock_release (&cache_lock);
+}
+
+/* Flusher thread. */
+/* Every FLUSH_INTERVAL, writes back the modified mmap pages. A
+   page being written stays in mmap_pages, so the walk can go on
+   from it. */
+static void
+flusher (void *aux UNUSED)
+{
+  struct list_elem *e;
+
+  for (;;)
+  {
+    timer_sleep (FLUSH_INTERVAL);
+    lock_acquire (&cache_lock);
+    for (e = list_begin (&mmap_pages); e != list_end (&mmap_pages);
+      e = list_next (e))
+      clean_page (list_entry (e, struct cached_page, mmap_elem));
+    lock_release (&cache_lock);
+  }
+}
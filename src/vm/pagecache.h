@@ -0,0 +1,37 @@
+#ifndef VM_PAGECACHE_H
+#define VM_PAGECACHE_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+struct inode;
+struct cached_page;
+
+void pagecache_init (void);
+bool pagecache_shareable (struct spt_entry *spe);
+bool pagecache_load_page (struct spt_entry *spe);
+bool pagecache_load_around (struct spt_entry *spe);
+void pagecache_unmap (struct spt_entry *spe);
+
+bool pagecache_try_lock (void);
+void pagecache_unlock (void);
+bool pagecache_accessed (struct frame_table_entry *fte);
+bool pagecache_dirty (struct frame_table_entry *fte);
+bool pagecache_writing (struct frame_table_entry *fte);
+struct cached_page *pagecache_evict (struct frame_table_entry *fte);
+bool pagecache_write_back (struct cached_page *cp,
+  struct frame_table_entry *fte);
+
+bool pagecache_share (struct spt_entry *parent, struct spt_entry *child);
+bool pagecache_break_cow (struct spt_entry *spe);
+
+void pagecache_clean (struct spt_entry *spe);
+
+bool pagecache_read (struct inode *inode, off_t offset, void *buffer,
+  off_t size);
+void pagecache_write (struct inode *inode, off_t offset,
+  const void *buffer, off_t size);
+
+#endif
@@ -1,15 +1,23 @@
 #include <bitmap.h>
+#include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 
-#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 #define SWAP_FREE false
 #define SWAP_USED true
 
 struct block *swap_device;
-struct bitmap *swap_table; /* swap table is a bitmap. */
+
+/* Swap table is a bitmap with one bit per page-sized slot. */
+/* Slot i starts at sector i * SECTORS_PER_PAGE. */
+struct bitmap *swap_table;
+size_t swap_free_cnt;   /* Number of free slots. */
+size_t swap_hint;       /* Next-fit cursor: where the next scan starts. */
+
+/* Protects the three above. Never held during I/O. */
 struct lock swap_table_lock;
 
 /* Init swap table. */
@@ -22,32 +30,127 @@ swap_table_init (void)
   if (swap_device == NULL)
     return;
   else
-    swap_table = bitmap_create (block_size (swap_device)); 
+    swap_table = bitmap_create (block_size (swap_device) / SECTORS_PER_PAGE); 
   
   if (swap_table == NULL)
     PANIC ("Can't Create Swap Table !");
 
+  swap_free_cnt = bitmap_size (swap_table);
+  swap_hint = 0;
+
   lock_init (&swap_table_lock);
+  zswap_init ();
+}
+
+/* Read or write the cnt pages at addrs from or to the swap
+   slots starting at sectors, skipping slots (block_sector_t) -1. */
+/* Pages are stored in or loaded from the compressed swap cache
+   if possible, the others go to disk. Submit all requests before
+   waiting for any of them, so that the block layer can merge
+   requests for adjacent slots. Requests of pages not on disk
+   keep a null buffer. Without memory for requests, transfer
+   synchronously. */
+static void
+transfer_pages (uint8_t **addrs, block_sector_t *sectors, size_t cnt,
+  bool is_write)
+{
+  struct block_request *reqs = malloc (cnt * sizeof *reqs);
+  size_t i;
+
+  for (i = 0 ; i < cnt ; i++)
+  {
+    if (reqs != NULL)
+      reqs[i].buffer = NULL;
+    if (sectors[i] == (block_sector_t) -1)
+      continue;
+    size_t slot = sectors[i] / SECTORS_PER_PAGE;
+    if (is_write ? zswap_store (slot, addrs[i]) : zswap_load (slot, addrs[i]))
+      continue;
+
+    if (reqs != NULL)
+    {
+      block_request_init (&reqs[i], sectors[i], addrs[i], SECTORS_PER_PAGE,
+        is_write, NULL, NULL);
+      block_submit (swap_device, &reqs[i]);
+    }
+    else if (is_write)
+      block_write_multiple (swap_device, sectors[i], addrs[i], 
+        SECTORS_PER_PAGE);
+    else
+      block_read_multiple (swap_device, sectors[i], addrs[i], 
+        SECTORS_PER_PAGE);
+  }
+  if (reqs != NULL)
+  {
+    for (i = 0 ; i < cnt ; i++)
+      if (reqs[i].buffer != NULL)
+        block_wait (&reqs[i]);
+    free (reqs);
+  }
+}
+
+/* Allocate cnt contiguous swap slots, searching from the
+   next-fit cursor and wrapping around. */
+/* Return the first slot, or BITMAP_ERROR if there is no such
+   run. Must hold swap_table_lock. */
+static size_t
+alloc_slots (size_t cnt)
+{
+  size_t slot = bitmap_scan_and_flip (swap_table, swap_hint, cnt, SWAP_FREE);
+  if (slot == BITMAP_ERROR && swap_hint > 0)
+    slot = bitmap_scan_and_flip (swap_table, 0, cnt, SWAP_FREE);
+  if (slot == BITMAP_ERROR)
+    return BITMAP_ERROR;
+
+  swap_free_cnt -= cnt;
+  swap_hint = slot + cnt;
+  if (swap_hint >= bitmap_size (swap_table))
+    swap_hint = 0;
+  return slot;
 }
 
-/* Allocate a swap slot. */
+/* Allocate a swap slot and write the page at addr to it. */
+/* Return the slot's first sector, or (block_sector_t) -1 if
+   swap is full. */
 block_sector_t
 swap_alloc (uint8_t *addr)
+{
+  block_sector_t sector_id;
+  swap_alloc_cluster (&addr, &sector_id, 1);
+  return sector_id;
+}
+
+/* Allocate swap slots for the cnt pages at addrs and write the
+   pages to them. */
+/* The slots are contiguous if possible, so that the block layer
+   merges the writes into one sequential transfer. */
+/* Store each page's first sector in sectors, or 
+   (block_sector_t) -1 if swap is full. */
+void
+swap_alloc_cluster (uint8_t **addrs, block_sector_t *sectors, size_t cnt)
 {
   ASSERT (swap_table != NULL);
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+  size_t i;
+
   lock_acquire (&swap_table_lock);
-  size_t sector_id = bitmap_scan_and_flip (swap_table, 0, SECTORS_PER_PAGE, SWAP_FREE);
-  lock_release (&swap_table_lock);
-  if (sector_id == BITMAP_ERROR)
-    return (block_sector_t) -1;
-  int i;
-  for (i = 0 ; i < SECTORS_PER_PAGE ; i++)
+  size_t slot = cnt <= swap_free_cnt ? alloc_slots (cnt) : BITMAP_ERROR;
+  for (i = 0 ; i < cnt ; i++)
   {
-    block_write (swap_device, (block_sector_t)(i + sector_id), 
-      addr + i * BLOCK_SECTOR_SIZE);
+    if (slot != BITMAP_ERROR)
+      sectors[i] = (block_sector_t) ((slot + i) * SECTORS_PER_PAGE);
+    else
+    {
+      /* No room for the whole cluster, place pages one by one. */
+      size_t page_slot = swap_free_cnt > 0 ? alloc_slots (1) : BITMAP_ERROR;
+      sectors[i] = page_slot != BITMAP_ERROR 
+        ? (block_sector_t) (page_slot * SECTORS_PER_PAGE) 
+        : (block_sector_t) -1;
+    }
   }
+  lock_release (&swap_table_lock);
 
-  return (block_sector_t) sector_id;
+  transfer_pages (addrs, sectors, cnt, true);
 }
 
 /* Get the page back to addr and clear the swap slot. */
@@ -55,25 +158,36 @@ void
 swap_free (uint8_t *addr, block_sector_t sector_id)
 {
   ASSERT (swap_table != NULL);
-  int i;
-  for (i = 0 ; i < SECTORS_PER_PAGE ; i++)
-  {
-    block_read (swap_device, (block_sector_t)(i + sector_id), 
-      addr + i * BLOCK_SECTOR_SIZE);
-  }
+  transfer_pages (&addr, &sector_id, 1, false);
 
   swap_clear (sector_id);
 
   return;
 }
 
+/* Read the cnt pages in the swap slots starting at sectors into
+   addrs, without freeing the slots. */
+void
+swap_read_cluster (uint8_t **addrs, block_sector_t *sectors, size_t cnt)
+{
+  ASSERT (swap_table != NULL);
+  transfer_pages (addrs, sectors, cnt, false);
+}
+
 /* Delete the swap slot in swap table. */
 void
 swap_clear (block_sector_t sector_id)
 { 
   ASSERT (swap_table != NULL);
+  ASSERT (sector_id % SECTORS_PER_PAGE == 0);
+  size_t slot = sector_id / SECTORS_PER_PAGE;
+
+  /* Drop the compressed copy before the slot can be reused. */
+  zswap_invalidate (slot);
   lock_acquire (&swap_table_lock);
-  bitmap_set_multiple (swap_table, (size_t) sector_id, SECTORS_PER_PAGE, SWAP_FREE);
+  ASSERT (bitmap_test (swap_table, slot) == SWAP_USED);
+  bitmap_set (swap_table, slot, SWAP_FREE);
+  swap_free_cnt++;
   lock_release (&swap_table_lock);
 
   return;
@@ -1,11 +1,20 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include <stddef.h>
 #include "devices/block.h"
+#include "threads/vaddr.h"
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most pages written to swap as one cluster. */
+#define SWAP_CLUSTER 8
 
 void swap_table_init (void);
 block_sector_t swap_alloc (uint8_t *addr);
+void swap_alloc_cluster (uint8_t **addrs, block_sector_t *sectors, size_t cnt);
 void swap_free (uint8_t *addr, block_sector_t sector_id);
+void swap_read_cluster (uint8_t **addrs, block_sector_t *sectors, size_t cnt);
 void swap_clear (block_sector_t sector_id);
 
-#endif
\ No newline at end of file
+#endif
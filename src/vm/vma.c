@@ -0,0 +1,99 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Each process describes its executable segments and mmaps as a
+   few ranges in its vma_list, instead of one supplemental page
+   table entry per page. The entry of a page is made from its
+   area when the page is first touched (see spt_lookup), so a
+   large mapping costs one vma until it is used. */
+
+/* Add an area of page_cnt pages from start to the current
+   process. Return false if it overlaps another area or out of
+   memory. */
+bool
+vma_add (int type, uint8_t *start, size_t page_cnt, bool writable,
+         struct file *file, off_t ofs, uint32_t read_bytes)
+{
+  struct thread *t = thread_current ();
+  struct vma *vma;
+  uint8_t *end = start + page_cnt * PGSIZE;
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (read_bytes <= page_cnt * PGSIZE);
+
+  if (end <= start || vma_overlaps (start, end))
+    return false;
+  vma = malloc (sizeof *vma);
+  if (vma == NULL)
+    return false;
+
+  vma->start = start;
+  vma->end = end;
+  vma->type = type;
+  vma->writable = writable;
+  vma->file = file;
+  vma->ofs = ofs;
+  vma->read_bytes = read_bytes;
+  list_init (&vma->pages);
+  list_push_back (&t->vma_list, &vma->elem);
+  return true;
+}
+
+/* Return the current process's area holding upage, or NULL. */
+struct vma *
+vma_find (const void *upage)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->vma_list); e != list_end (&t->vma_list);
+       e = list_next (e))
+  {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    if ((const uint8_t *) upage >= vma->start
+      && (const uint8_t *) upage < vma->end)
+      return vma;
+  }
+  return NULL;
+}
+
+/* Return true if any area of the current process overlaps the
+   pages from start to end. */
+bool
+vma_overlaps (const uint8_t *start, const uint8_t *end)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->vma_list); e != list_end (&t->vma_list);
+       e = list_next (e))
+  {
+    struct vma *vma = list_entry (e, struct vma, elem);
+    if (start < vma->end && vma->start < end)
+      return true;
+  }
+  return false;
+}
+
+/* Remove vma, whose pages must be gone already. */
+void
+vma_remove (struct vma *vma)
+{
+  ASSERT (list_empty (&vma->pages));
+  list_remove (&vma->elem);
+  free (vma);
+}
+
+/* Free all areas of the current process. */
+/* Called when process exits, after its pages are gone. */
+void
+vma_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->vma_list))
+    free (list_entry (list_pop_front (&t->vma_list), struct vma, elem));
+}
@@ -0,0 +1,39 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+/* A virtual memory area: a range of pages of a process mapped
+   the same way, an executable segment or an mmap. */
+struct vma
+{
+	uint8_t *start;     /* First page. */
+	uint8_t *end;       /* Just past the last page. */
+	int type;           /* Page type, see vm/page.h. */
+	bool writable;      /* Are the pages writable? */
+
+	/* File data of the area: read_bytes bytes from ofs in file,
+	   followed by zeros up to end. */
+	struct file *file;
+	off_t ofs;
+	uint32_t read_bytes;
+
+	/* The area's pages with a supplemental page table entry, that
+	   is the ones touched so far. */
+	struct list pages;
+
+	struct list_elem elem; /* Elem used for thread's vma_list. */
+};
+
+bool vma_add (int type, uint8_t *start, size_t page_cnt, bool writable,
+              struct file *file, off_t ofs, uint32_t read_bytes);
+struct vma *vma_find (const void *upage);
+bool vma_overlaps (const uint8_t *start, const uint8_t *end);
+void vma_remove (struct vma *vma);
+void vma_destroy (void);
+
+#endif
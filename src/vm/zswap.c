@@ -0,0 +1,421 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* Compressed swap cache.
+
+   Pages written to swap are compressed first, with a small LZ77
+   compressor in the style of LZ4, and kept in a pool of kernel
+   pages instead of being written to disk. A later read of the
+   slot decompresses the page, which is much faster than a disk
+   read. The disk slot stays allocated, so a page that doesn't
+   fit in the pool, or compresses poorly, simply goes to disk. */
+
+/* Compressor hash table size. */
+#define HASH_BITS 12
+
+/* Shortest match the compressor encodes. */
+#define MIN_MATCH 4
+
+/* A page of the pool. Holds up to two compressed pages, the
+   first one at the start of the page, the last one at its end
+   (as in zbud). */
+struct zpage
+{
+  uint8_t *kpage;       /* Kernel page holding the data. */
+  uint16_t size[2];     /* Bytes of first and last buddy, 0 if free. */
+  struct list_elem elem; /* Elem used for unbuddied, if one is free. */
+};
+
+/* A swap slot whose page is in the pool. */
+struct zswap_entry
+{
+  size_t slot;          /* Swap slot. */
+  struct zpage *zp;     /* Pool page holding the data. */
+  int buddy;            /* 0 for first buddy, 1 for last. */
+  struct hash_elem elem; /* Elem used for entries. */
+};
+
+static struct hash entries;     /* Slots in the pool. */
+static struct list unbuddied;   /* Pool pages with a free buddy. */
+static size_t pool_page_cnt;    /* Number of pages in the pool. */
+
+/* Compressor working memory. */
+static uint16_t hash_table[1 << HASH_BITS];
+static uint8_t zbuf[ZSWAP_MAX_SIZE];
+
+/* Protects all of the above and the statistics. */
+static struct lock zswap_lock;
+
+/* Statistics. */
+static unsigned long long store_cnt;    /* Pages stored. */
+static unsigned long long store_bytes;  /* Compressed bytes stored. */
+static unsigned long long poor_cnt;     /* Pages that compressed poorly. */
+static unsigned long long full_cnt;     /* Pages rejected, pool full. */
+static unsigned long long hit_cnt;      /* Reads served from the pool. */
+static unsigned long long miss_cnt;     /* Reads left to the disk. */
+
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int ((int) hash_entry (e, struct zswap_entry, elem)->slot);
+}
+
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+  void *aux UNUSED)
+{
+  return hash_entry (a, struct zswap_entry, elem)->slot
+    < hash_entry (b, struct zswap_entry, elem)->slot;
+}
+
+/* Init the compressed swap cache. */
+void
+zswap_init (void)
+{
+  if (!hash_init (&entries, entry_hash, entry_less, NULL))
+    PANIC ("Can't Create Zswap Table !");
+  list_init (&unbuddied);
+  pool_page_cnt = 0;
+  lock_init (&zswap_lock);
+}
+
+static uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Write the length len, whose first 15 are in a token, to dst
+   as extra bytes. Return the new end of dst, or NULL if it would
+   pass end. */
+static uint8_t *
+put_length (uint8_t *dst, uint8_t *end, size_t len)
+{
+  if (len < 15)
+    return dst;
+  for (len -= 15 ; ; len -= 255)
+  {
+    if (dst >= end)
+      return NULL;
+    *dst++ = len < 255 ? len : 255;
+    if (len < 255)
+      return dst;
+  }
+}
+
+/* Append a sequence to dst: the lit_len literals at lit, then a
+   match of match_len bytes at offset back, if match_len is not
+   0. Return the new end of dst, or NULL if it would pass end. */
+static uint8_t *
+put_sequence (uint8_t *dst, uint8_t *end, const uint8_t *lit,
+  size_t lit_len, size_t offset, size_t match_len)
+{
+  size_t match_code = match_len != 0 ? match_len - MIN_MATCH : 0;
+  uint8_t *token = dst++;
+
+  if (token >= end)
+    return NULL;
+  *token = ((lit_len < 15 ? lit_len : 15) << 4)
+    | (match_code < 15 ? match_code : 15);
+  dst = put_length (dst, end, lit_len);
+  if (dst == NULL || (size_t) (end - dst) < lit_len)
+    return NULL;
+  memcpy (dst, lit, lit_len);
+  dst += lit_len;
+  if (match_len == 0)
+    return dst;
+
+  if (end - dst < 2)
+    return NULL;
+  *dst++ = offset & 0xff;
+  *dst++ = offset >> 8;
+  return put_length (dst, end, match_code);
+}
+
+/* Compress the page src into dst, which has room for size bytes.
+   Return the compressed size, or 0 if it is more than size. */
+/* The output is a series of sequences, each a token holding the
+   number of literals and the match length less MIN_MATCH, extra
+   length bytes for literals, the literals, the match offset and
+   extra length bytes for the match. The last sequence has
+   literals only. Must hold zswap_lock. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t size)
+{
+  uint8_t *op = dst, *end = dst + size;
+  size_t ip = 0, anchor = 0;
+
+  memset (hash_table, 0, sizeof hash_table);
+  while (ip + MIN_MATCH <= PGSIZE)
+  {
+    uint32_t v = read32 (src + ip);
+    unsigned h = (v * 2654435761u) >> (32 - HASH_BITS);
+    size_t ref = hash_table[h];
+    hash_table[h] = ip;
+
+    if (ref >= ip || read32 (src + ref) != v)
+    {
+      ip++;
+      continue;
+    }
+
+    size_t len = MIN_MATCH;
+    while (ip + len < PGSIZE && src[ref + len] == src[ip + len])
+      len++;
+    op = put_sequence (op, end, src + anchor, ip - anchor, ip - ref, len);
+    if (op == NULL)
+      return 0;
+    ip += len;
+    anchor = ip;
+  }
+
+  op = put_sequence (op, end, src + anchor, PGSIZE - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Read the extra bytes of a length whose token part is len from
+   src, which ends at end. Return the length, or (size_t) -1 on
+   corrupt input. */
+static size_t
+get_length (const uint8_t **src, const uint8_t *end, size_t len)
+{
+  uint8_t b;
+
+  if (len < 15)
+    return len;
+  do
+  {
+    if (*src >= end)
+      return (size_t) -1;
+    b = *(*src)++;
+    len += b;
+  }
+  while (b == 255);
+  return len;
+}
+
+/* Decompress the size bytes at src, made by lz_compress, into
+   the page dst. Return false if they are corrupt. */
+static bool
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+  const uint8_t *end = src + size;
+  size_t op = 0;
+
+  while (src < end)
+  {
+    uint8_t token = *src++;
+    size_t lit_len = get_length (&src, end, token >> 4);
+    if (lit_len > (size_t) (end - src) || lit_len > PGSIZE - op)
+      return false;
+    memcpy (dst + op, src, lit_len);
+    src += lit_len;
+    op += lit_len;
+    if (op == PGSIZE)
+      return src == end;
+
+    if (end - src < 2)
+      return false;
+    size_t offset = src[0] | (src[1] << 8);
+    src += 2;
+    size_t len = get_length (&src, end, token & 15);
+    if (len == (size_t) -1)
+      return false;
+    len += MIN_MATCH;
+    if (offset == 0 || offset > op || len > PGSIZE - op)
+      return false;
+
+    /* Copy byte by byte, the match may overlap its output. */
+    for ( ; len > 0 ; len--, op++)
+      dst[op] = dst[op - offset];
+  }
+  return false;
+}
+
+/* Return a pool page with size bytes free, taking a new page
+   from the kernel pool if none has room. Set *buddy to the free
+   buddy. Return NULL if the pool is full. Must hold zswap_lock. */
+static struct zpage *
+pool_alloc (size_t size, int *buddy)
+{
+  struct list_elem *e;
+  struct zpage *zp;
+
+  for (e = list_begin (&unbuddied); e != list_end (&unbuddied);
+    e = list_next (e))
+  {
+    zp = list_entry (e, struct zpage, elem);
+    if (zp->size[0] + zp->size[1] + size <= PGSIZE)
+    {
+      list_remove (&zp->elem);
+      *buddy = zp->size[0] == 0 ? 0 : 1;
+      return zp;
+    }
+  }
+
+  if (pool_page_cnt >= ZSWAP_POOL_PAGES)
+    return NULL;
+  zp = malloc (sizeof *zp);
+  if (zp == NULL)
+    return NULL;
+  zp->kpage = palloc_get_page (0);
+  if (zp->kpage == NULL)
+  {
+    free (zp);
+    return NULL;
+  }
+  zp->size[0] = zp->size[1] = 0;
+  pool_page_cnt++;
+  *buddy = 0;
+  return zp;
+}
+
+/* Return the data of buddy of zp. */
+static uint8_t *
+buddy_data (struct zpage *zp, int buddy)
+{
+  return buddy == 0 ? zp->kpage : zp->kpage + PGSIZE - zp->size[1];
+}
+
+/* Free buddy of zp, and zp itself if it becomes empty. Must hold
+   zswap_lock. */
+static void
+pool_free (struct zpage *zp, int buddy)
+{
+  bool was_full = zp->size[0] != 0 && zp->size[1] != 0;
+
+  zp->size[buddy] = 0;
+  if (zp->size[0] == 0 && zp->size[1] == 0)
+  {
+    list_remove (&zp->elem);
+    palloc_free_page (zp->kpage);
+    free (zp);
+    pool_page_cnt--;
+  }
+  else if (was_full)
+    list_push_back (&unbuddied, &zp->elem);
+}
+
+/* Find the entry of slot. Must hold zswap_lock. */
+static struct zswap_entry *
+find_entry (size_t slot)
+{
+  struct zswap_entry key;
+  struct hash_elem *e;
+
+  key.slot = slot;
+  e = hash_find (&entries, &key.elem);
+  return e != NULL ? hash_entry (e, struct zswap_entry, elem) : NULL;
+}
+
+/* Compress page, written to swap slot, into the pool. */
+/* Return true if successful, false if it compresses poorly or
+   the pool is full, in which case the page must go to disk. */
+bool
+zswap_store (size_t slot, const uint8_t *page)
+{
+  struct zswap_entry *ze;
+  struct zpage *zp;
+  int buddy;
+
+  lock_acquire (&zswap_lock);
+  ASSERT (find_entry (slot) == NULL);
+  size_t size = lz_compress (page, zbuf, sizeof zbuf);
+  if (size == 0)
+  {
+    poor_cnt++;
+    lock_release (&zswap_lock);
+    return false;
+  }
+
+  ze = malloc (sizeof *ze);
+  zp = ze != NULL ? pool_alloc (size, &buddy) : NULL;
+  if (zp == NULL)
+  {
+    free (ze);
+    full_cnt++;
+    lock_release (&zswap_lock);
+    return false;
+  }
+
+  /* A pool page with one buddy used is on unbuddied. */
+  zp->size[buddy] = size;
+  memcpy (buddy_data (zp, buddy), zbuf, size);
+  if (zp->size[!buddy] == 0)
+    list_push_back (&unbuddied, &zp->elem);
+
+  ze->slot = slot;
+  ze->zp = zp;
+  ze->buddy = buddy;
+  hash_insert (&entries, &ze->elem);
+  store_cnt++;
+  store_bytes += size;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Read the page of swap slot from the pool into page, keeping
+   it in the pool. */
+/* Return true if successful, false if slot is not in the pool,
+   in which case the page must be read from disk. */
+bool
+zswap_load (size_t slot, uint8_t *page)
+{
+  struct zswap_entry *ze;
+
+  lock_acquire (&zswap_lock);
+  ze = find_entry (slot);
+  if (ze == NULL)
+  {
+    miss_cnt++;
+    lock_release (&zswap_lock);
+    return false;
+  }
+  if (!lz_decompress (buddy_data (ze->zp, ze->buddy),
+    ze->zp->size[ze->buddy], page))
+    PANIC ("corrupt compressed swap page");
+  hit_cnt++;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Drop swap slot from the pool, if it is there. Called when the
+   slot is freed. */
+void
+zswap_invalidate (size_t slot)
+{
+  struct zswap_entry *ze;
+
+  lock_acquire (&zswap_lock);
+  ze = find_entry (slot);
+  if (ze != NULL)
+  {
+    hash_delete (&entries, &ze->elem);
+    pool_free (ze->zp, ze->buddy);
+    free (ze);
+  }
+  lock_release (&zswap_lock);
+}
+
+/* Print compressed swap cache statistics. */
+void
+zswap_print_stats (void)
+{
+  unsigned long long ratio = store_bytes != 0 
+    ? store_cnt * PGSIZE * 100 / store_bytes : 0;
+
+  printf ("Zswap: %llu pages stored, %llu compressed poorly, "
+          "%llu pool full, ratio %llu.%02llu\n",
+          store_cnt, poor_cnt, full_cnt, ratio / 100, ratio % 100);
+  printf ("Zswap: %llu hits, %llu misses, %zu pool pages\n",
+          hit_cnt, miss_cnt, pool_page_cnt);
+}
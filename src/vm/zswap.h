@@ -0,0 +1,22 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Most kernel pages the compressed pool takes. */
+#define ZSWAP_POOL_PAGES 64
+
+/* Pages that don't compress to this many bytes or less go to
+   disk. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+void zswap_init (void);
+bool zswap_store (size_t slot, const uint8_t *page);
+bool zswap_load (size_t slot, uint8_t *page);
+void zswap_invalidate (size_t slot);
+void zswap_print_stats (void);
+
+#endif